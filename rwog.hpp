@@ -1,249 +1,3163 @@
-#include <set>
 #include <random>
 #include <optional>
 #include <vector>
+#include <string>
+#include <array>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <climits>
+#include <type_traits>
+#include <functional>
+#include <string_view>
+#include <cstring>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <iterator>
+#include <exception>
+#if __has_include(<span>)
+#include <span>
+#endif
 using namespace std;
 using uint = unsigned int;
 
 namespace dzunni
 {
+    /**
+     * @brief
+     * SplitMix64 by Sebastiano Vigna, 8 bytes of state. Mostly used to expand a seed into the state of the other
+     * generators.
+     */
+    class SplitMix64 {
+    private:
+        uint64_t _state;
+
+    public:
+        using result_type = uint64_t;
+
+        explicit SplitMix64(uint64_t seed = 0) : _state(seed) {}
+
+        void seed(uint64_t seed){
+            _state = seed;
+        }
+
+        static constexpr result_type min(){ return 0; }
+        static constexpr result_type max(){ return UINT64_MAX; }
+
+        result_type operator()(){
+            uint64_t z = (_state += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            return z ^ (z >> 31);
+        }
+    };
+
+    /**
+     * @brief
+     * xoshiro256++ by David Blackman and Sebastiano Vigna, 32 bytes of state and 64 bits per call. The default
+     * randomizer of `RandomWeightedObjectGenerator`.
+     */
+    class Xoshiro256PlusPlus {
+    private:
+        uint64_t _state[4];
+
+        static uint64_t rotl(uint64_t x, int k){
+            return (x << k) | (x >> (64 - k));
+        }
+
+    public:
+        using result_type = uint64_t;
+
+        explicit Xoshiro256PlusPlus(uint64_t seed = 0){
+            this->seed(seed);
+        }
+
+        void seed(uint64_t seed){
+            SplitMix64 expander(seed);
+            for(uint64_t &word : _state)
+                word = expander();
+        }
+
+        static constexpr result_type min(){ return 0; }
+        static constexpr result_type max(){ return UINT64_MAX; }
+
+        result_type operator()(){
+            uint64_t result = rotl(_state[0] + _state[3], 23) + _state[0];
+            uint64_t t = _state[1] << 17;
+            _state[2] ^= _state[0];
+            _state[3] ^= _state[1];
+            _state[1] ^= _state[2];
+            _state[0] ^= _state[3];
+            _state[2] ^= t;
+            _state[3] = rotl(_state[3], 45);
+            return result;
+        }
+
+        /**
+         * @brief Advances the state by 2^128 calls, which gives 2^128 non-overlapping streams of 2^128 numbers.
+         */
+        void jump(){
+            static constexpr uint64_t polynomial[4] = {
+                0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+            jumpBy(polynomial);
+        }
+
+        /**
+         * @brief Advances the state by 2^192 calls, e.g. to give every machine its own range of `jump()` streams.
+         */
+        void longJump(){
+            static constexpr uint64_t polynomial[4] = {
+                0x76e15d3efefdcbbf, 0xc5004e441c522fb3, 0x77710069854ee241, 0x39109bb02acbe635 };
+            jumpBy(polynomial);
+        }
+
+    private:
+        void jumpBy(const uint64_t (&polynomial)[4]){
+            uint64_t state[4] = {};
+            for(uint64_t word : polynomial){
+                for(int b = 0; b < 64; b++){
+                    if(word & (uint64_t(1) << b))
+                        for(int i = 0; i < 4; i++)
+                            state[i] ^= _state[i];
+                    (*this)();
+                }
+            }
+            memcpy(_state, state, sizeof(_state));
+        }
+    };
+
+    /**
+     * @brief
+     * PCG32 (XSH RR) by Melissa O'Neill, 16 bytes of state and 32 bits per call.
+     */
+    class Pcg32 {
+    private:
+        uint64_t _state;
+        uint64_t _increment;
+
+    public:
+        using result_type = uint32_t;
+
+        explicit Pcg32(uint64_t seed = 0, uint64_t stream = 0){
+            this->seed(seed, stream);
+        }
+
+        void seed(uint64_t seed, uint64_t stream = 0){
+            _state = 0;
+            _increment = (stream << 1) | 1;
+            (*this)();
+            _state += seed;
+            (*this)();
+        }
+
+        static constexpr result_type min(){ return 0; }
+        static constexpr result_type max(){ return UINT32_MAX; }
+
+        result_type operator()(){
+            uint64_t old_state = _state;
+            _state = old_state * 6364136223846793005ULL + _increment;
+            uint32_t xorshifted = ((old_state >> 18) ^ old_state) >> 27;
+            uint32_t rot = old_state >> 59;
+            return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+        }
+    };
+
+    /**
+     * @brief
+     * Philox4x32-10 by Salmon et al., a counter-based generator: every block of 4 outputs is a keyed hash of a
+     * 128-bit counter, so any position can be reached in O(1) with `seek()`. The key is the seed, the high half of
+     * the counter is the stream and the low half counts blocks. 32 bits per call.
+     */
+    class Philox4x32 {
+    private:
+        uint32_t _key[2];
+        uint32_t _counter[4];
+        uint32_t _block[4];
+        unsigned _next = 4;
+
+        static uint32_t mulhilo(uint32_t a, uint32_t b, uint32_t &high){
+            uint64_t product = (uint64_t) a * b;
+            high = product >> 32;
+            return (uint32_t) product;
+        }
+
+        void generate(){
+            uint32_t key[2] = { _key[0], _key[1] };
+            memcpy(_block, _counter, sizeof(_block));
+            for(int round = 0; round < 10; round++){
+                uint32_t high0, high1;
+                uint32_t low0 = mulhilo(0xD2511F53, _block[0], high0);
+                uint32_t low1 = mulhilo(0xCD9E8D57, _block[2], high1);
+                uint32_t block[4] = { high1 ^ _block[1] ^ key[0], low1, high0 ^ _block[3] ^ key[1], low0 };
+                memcpy(_block, block, sizeof(_block));
+                key[0] += 0x9E3779B9;
+                key[1] += 0xBB67AE85;
+            }
+            if(++_counter[0] == 0)
+                ++_counter[1];
+        }
+
+    public:
+        using result_type = uint32_t;
+
+        explicit Philox4x32(uint64_t seed = 0, uint64_t stream = 0){
+            this->seed(seed, stream);
+        }
+
+        void seed(uint64_t seed, uint64_t stream = 0){
+            _key[0] = (uint32_t) seed;
+            _key[1] = seed >> 32;
+            _counter[2] = (uint32_t) stream;
+            _counter[3] = stream >> 32;
+            seek(0);
+        }
+
+        /**
+         * @brief Moves to the start of block `block` of the stream, the output number `4 * block`.
+         */
+        void seek(uint64_t block){
+            _counter[0] = (uint32_t) block;
+            _counter[1] = block >> 32;
+            _next = 4;
+        }
+
+        static constexpr result_type min(){ return 0; }
+        static constexpr result_type max(){ return UINT32_MAX; }
+
+        result_type operator()(){
+            if(_next == 4){
+                generate();
+                _next = 0;
+            }
+            return _block[_next++];
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief Marks a missing slot.
+         */
+        inline constexpr unsigned int npos = UINT_MAX;
+
+        /**
+         * @brief Returns the number of trailing zero bits of a non-zero `x`.
+         */
+        inline unsigned countTrailingZeros(uint64_t x){
+#if defined(__GNUC__)
+            return __builtin_ctzll(x);
+#else
+            unsigned count = 0;
+            for(; !(x & 1); x >>= 1)
+                ++count;
+            return count;
+#endif
+        }
+
+        /**
+         * @brief Returns the number of leading zero bits of a non-zero `x`.
+         */
+        inline unsigned countLeadingZeros(uint64_t x){
+#if defined(__GNUC__)
+            return __builtin_clzll(x);
+#else
+            unsigned count = 0;
+            for(; !(x >> 63); x <<= 1)
+                ++count;
+            return count;
+#endif
+        }
+
+        /**
+         * @brief Returns 32 random bits. 64-bit engines give their high half.
+         */
+        template<typename URBG>
+        uint32_t random32(URBG &rng){
+            static_assert(URBG::min() == 0 && (URBG::max() == UINT32_MAX || URBG::max() == UINT64_MAX),
+                "The randomizer must output every 32-bit or every 64-bit value.");
+            if constexpr(URBG::max() == UINT64_MAX)
+                return rng() >> 32;
+            else
+                return rng();
+        }
+
+        /**
+         * @brief Returns 64 random bits. 32-bit engines are called twice, high half first.
+         */
+        template<typename URBG>
+        uint64_t random64(URBG &rng){
+            static_assert(URBG::min() == 0 && (URBG::max() == UINT32_MAX || URBG::max() == UINT64_MAX),
+                "The randomizer must output every 32-bit or every 64-bit value.");
+            if constexpr(URBG::max() == UINT64_MAX){
+                return rng();
+            }
+            else{
+                uint64_t high = rng();
+                return (high << 32) | (uint32_t) rng();
+            }
+        }
+
+        /**
+         * @brief Returns a uniform integer in `[0, bound)` with Lemire's nearly divisionless method. The division only
+         * happens when the first multiply lands in the biased zone, which has a probability of `bound / 2^32`.
+         */
+        template<typename URBG>
+        uint bounded(URBG &rng, uint bound){
+            uint64_t product = (uint64_t) random32(rng) * bound;
+            uint32_t low = (uint32_t) product;
+            if(low < bound){
+                uint32_t threshold = (0u - bound) % bound;
+                while(low < threshold){
+                    product = (uint64_t) random32(rng) * bound;
+                    low = (uint32_t) product;
+                }
+            }
+            return product >> 32;
+        }
+
+        /**
+         * @brief Returns a uniform double in the open interval `(0, 1)` with 53 random bits.
+         */
+        template<typename URBG>
+        double uniform01(URBG &rng){
+            return ((random64(rng) >> 11) + 0.5) * 0x1.0p-53;
+        }
+
+        /**
+         * @brief Returns `log(k!) - log(sqrt(2 pi) (k + 1)^(k + 1/2) e^-(k + 1))`, the error of Stirling's formula.
+         */
+        inline double stirlingCorrection(uint64_t k){
+            static const double table[10] = {
+                0.08106146679532726, 0.04134069595540929, 0.02767792568499834, 0.02079067210376509,
+                0.01664469118982119, 0.01387612882307075, 0.01189670994589177, 0.01041126526197209,
+                0.009255462182712733, 0.008330563433362871
+            };
+            if(k < 10)
+                return table[k];
+            double r = 1.0 / (k + 1);
+            double r2 = r * r;
+            return (1.0 / 12 - (1.0 / 360 - r2 / 1260) * r2) * r;
+        }
+
+        /**
+         * @brief Returns the number of successes in `n` trials with probability `p`, in O(1) expected time for any `n`.
+         * Uses inversion when `n * min(p, 1 - p)` is below 10 and Hormann's BTRD otherwise.
+         */
+        template<typename URBG>
+        uint64_t binomial(URBG &rng, uint64_t n, double p){
+            if(n == 0 || p <= 0)
+                return 0;
+            if(p >= 1)
+                return n;
+            if(p > 0.5)
+                return n - binomial(rng, n, 1 - p);
+
+            double q = 1 - p;
+            if(n * p < 10){
+                double s = p / q;
+                double a = (n + 1) * s;
+                double r0 = exp(n * log1p(-p));
+                while(true){
+                    double u = uniform01(rng);
+                    double r = r0;
+                    uint64_t x = 0;
+                    while(u > r && x <= n){
+                        u -= r;
+                        ++x;
+                        r *= a / x - s;
+                    }
+                    // Rounding can leave `u` above the whole mass; draw again.
+                    if(x <= n)
+                        return x;
+                }
+            }
+
+            double spq = sqrt(n * p * q);
+            double b = 1.15 + 2.53 * spq;
+            double a = -0.0873 + 0.0248 * b + 0.01 * p;
+            double c = n * p + 0.5;
+            double alpha = (2.83 + 5.1 / b) * spq;
+            double vr = 0.92 - 4.2 / b;
+            double urvr = 0.86 * vr;
+            double m = floor((n + 1) * p);
+            double r = p / q;
+            double nr = (n + 1) * r;
+            double npq = n * p * q;
+
+            while(true){
+                double u, v = uniform01(rng);
+                if(v <= urvr){
+                    u = v / vr - 0.43;
+                    return floor((2 * a / (0.5 - fabs(u)) + b) * u + c);
+                }
+                if(v >= vr){
+                    u = uniform01(rng) - 0.5;
+                }
+                else{
+                    u = v / vr - 0.93;
+                    u = (u < 0 ? -0.5 : 0.5) - u;
+                    v = uniform01(rng) * vr;
+                }
+
+                double us = 0.5 - fabs(u);
+                double k = floor((2 * a / us + b) * u + c);
+                if(k < 0 || k > n)
+                    continue;
+                v = v * alpha / (a / (us * us) + b);
+                double km = fabs(k - m);
+                if(km <= 15){
+                    // Evaluate f(k) / f(m) by the recursion of the binomial probabilities.
+                    double f = 1;
+                    for(double i = m + 1; i <= k; ++i)
+                        f *= nr / i - r;
+                    for(double i = k + 1; i <= m; ++i)
+                        v *= nr / i - r;
+                    if(v <= f)
+                        return k;
+                    continue;
+                }
+
+                v = log(v);
+                double rho = (km / npq) * (((km / 3 + 0.625) * km + 1.0 / 6) / npq + 0.5);
+                double t = -km * km / (2 * npq);
+                if(v < t - rho)
+                    return k;
+                if(v > t + rho)
+                    continue;
+
+                double nm = n - m + 1;
+                double h = (m + 0.5) * log((m + 1) / (r * nm)) + stirlingCorrection(m) + stirlingCorrection(n - m);
+                double nk = n - k + 1;
+                if(v <= h + (n + 1) * log(nm / nk) + (k + 0.5) * log(nk * r / (k + 1))
+                    - stirlingCorrection(k) - stirlingCorrection(n - k))
+                    return k;
+            }
+        }
+
+        /**
+         * @brief Returns `floor(random * bound / 2^64)` without 128-bit arithmetic, for `bound` up to `2^32`.
+         */
+        inline uint64_t scale(uint64_t random, uint64_t bound){
+            uint64_t high = (random >> 32) * bound;
+            uint64_t low = ((random & UINT32_MAX) * bound) >> 32;
+            return (high + low) >> 32;
+        }
+
+        /**
+         * @brief Whether `K` can look up an `E` without constructing one: `K` is `E`, or it is a non-arithmetic type
+         * that compares with `E` both ways, such as `string_view` or `const char*` for `string`. Arithmetic types are
+         * still converted to `E` so that e.g. `3.5` keeps finding `3` in a generator of `int`.
+         */
+        template<typename E, typename K, typename = void>
+        struct IsKey : is_same<E, K> {};
+
+        template<typename E, typename K>
+        struct IsKey<E, K, void_t<decltype(declval<const E&>() < declval<const K&>()),
+            decltype(declval<const K&>() < declval<const E&>())>>
+        : bool_constant<is_same_v<E, K> || !is_arithmetic_v<K>> {};
+
+        /**
+         * @brief Whether the randomizer has a `jump()` that splits its sequence into non-overlapping streams.
+         */
+        template<typename URBG, typename = void>
+        struct HasJump : false_type {};
+
+        template<typename URBG>
+        struct HasJump<URBG, void_t<decltype(declval<URBG&>().jump())>> : true_type {};
+
+        /**
+         * @brief Calls `f(i)` for every `i` in `[0, count)` on `threads` threads, the calling one included, or on
+         * `thread::hardware_concurrency()` threads if it is 0. The threads take indices one by one, so `f` must not
+         * depend on which thread runs it. If `f` throws, the remaining indices are skipped and the first exception is
+         * rethrown once every thread has stopped.
+         */
+        template<typename F>
+        void parallelFor(size_t count, unsigned threads, F f){
+            if(threads == 0)
+                threads = max(thread::hardware_concurrency(), 1u);
+            threads = (unsigned) min<size_t>(threads, count);
+            if(threads <= 1){
+                for(size_t i = 0; i < count; i++)
+                    f(i);
+                return;
+            }
+            atomic<size_t> next{0};
+            mutex failure_mutex;
+            exception_ptr failure;
+            auto work = [&next, count, &f, &failure_mutex, &failure](){
+                try{
+                    for(size_t i; (i = next.fetch_add(1, memory_order_relaxed)) < count;)
+                        f(i);
+                }
+                catch(...){
+                    // The other threads stop after their current index, and the first exception is rethrown.
+                    next.store(count, memory_order_relaxed);
+                    lock_guard<mutex> lock(failure_mutex);
+                    if(!failure)
+                        failure = current_exception();
+                }
+            };
+            // Stops and joins the threads started so far on every way out, also when starting the next one throws,
+            // since destroying a joinable thread terminates.
+            struct Joiner {
+                atomic<size_t> &next;
+                size_t count;
+                vector<thread> pool;
+
+                ~Joiner(){
+                    next.store(count, memory_order_relaxed);
+                    for(thread &worker : pool)
+                        worker.join();
+                }
+            };
+            {
+                Joiner joiner{next, count, {}};
+                joiner.pool.reserve(threads - 1);
+                for(unsigned t = 1; t < threads; t++)
+                    joiner.pool.emplace_back(work);
+                work();
+            }
+            if(failure)
+                rethrow_exception(failure);
+        }
+
+        /**
+         * @brief The number of items a thread takes at once in the parallel builders. Blocks depend on the size only,
+         * never on the number of threads.
+         */
+        inline constexpr size_t parallel_grain = 1 << 16;
+
+        /**
+         * @brief Calls `f(begin, end)` for every block of `parallel_grain` items of `[0, n)` on `threads` threads.
+         */
+        template<typename F>
+        void parallelBlocks(size_t n, unsigned threads, F f){
+            size_t blocks = (n + parallel_grain - 1) / parallel_grain;
+            parallelFor(blocks, threads, [n, &f](size_t b){
+                f(b * parallel_grain, min(n, (b + 1) * parallel_grain));
+            });
+        }
+
+        /**
+         * @brief Writes the inclusive prefix sums of `n` values from `first` to `out`, which may be `first`. Every
+         * block is summed, the block sums are scanned, and every block is scanned again from its offset. Unsigned sums
+         * wrap the same in any order, so the result is identical to `partial_sum()`.
+         */
+        template<typename RandomIt, typename OutputIt>
+        void parallelPrefixSum(RandomIt first, size_t n, OutputIt out, unsigned threads){
+            using T = typename iterator_traits<OutputIt>::value_type;
+            if(threads == 1 || n <= parallel_grain){
+                partial_sum(first, first + n, out);
+                return;
+            }
+            vector<T> offsets((n + parallel_grain - 1) / parallel_grain + 1, 0);
+            parallelBlocks(n, threads, [&](size_t begin, size_t end){
+                offsets[begin / parallel_grain + 1] = accumulate(first + begin, first + end, T(0));
+            });
+            partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            parallelBlocks(n, threads, [&](size_t begin, size_t end){
+                T sum = offsets[begin / parallel_grain];
+                for(size_t i = begin; i < end; ++i){
+                    sum += first[i];
+                    out[i] = sum;
+                }
+            });
+        }
+
+        /**
+         * @brief Splits `[0, n)` into the indices where `pred` holds and the rest, both in increasing order. Every
+         * block counts its own, and then writes them from its offset.
+         */
+        template<typename F>
+        void parallelPartition(size_t n, unsigned threads, F pred, vector<uint32_t> &yes, vector<uint32_t> &no){
+            size_t blocks = (n + parallel_grain - 1) / parallel_grain;
+            vector<size_t> offsets(blocks + 1, 0);
+            parallelBlocks(n, threads, [&](size_t begin, size_t end){
+                size_t count = 0;
+                for(size_t i = begin; i < end; ++i)
+                    count += pred(i);
+                offsets[begin / parallel_grain + 1] = count;
+            });
+            partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            yes.resize(offsets.back());
+            no.resize(n - offsets.back());
+            parallelBlocks(n, threads, [&](size_t begin, size_t end){
+                size_t y = offsets[begin / parallel_grain];
+                size_t x = begin - y;
+                for(size_t i = begin; i < end; ++i){
+                    if(pred(i))
+                        yes[y++] = i;
+                    else
+                        no[x++] = i;
+                }
+            });
+        }
+
+        /**
+         * @brief Sorts pairs by their first value, keeping equal ones in order. An LSD radix sort of 11 bits a pass,
+         * with only as many passes as the largest first value needs, so it is O(n) where `std::sort` compares.
+         */
+        inline void radixSort(vector<pair<uint, uint>> &items){
+            constexpr unsigned bits = 11;
+            constexpr uint mask = (1u << bits) - 1;
+            uint largest = 0;
+            for(const pair<uint, uint> &item : items)
+                largest = max(largest, item.first);
+            vector<pair<uint, uint>> buffer(items.size());
+            vector<size_t> offsets(mask + 2);
+            for(unsigned shift = 0; shift < 32 && (largest >> shift) != 0; shift += bits){
+                fill(offsets.begin(), offsets.end(), 0);
+                for(const pair<uint, uint> &item : items)
+                    ++offsets[((item.first >> shift) & mask) + 1];
+                partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+                for(const pair<uint, uint> &item : items)
+                    buffer[offsets[(item.first >> shift) & mask]++] = item;
+                items.swap(buffer);
+            }
+        }
+    } // namespace detail
+
+    /**
+     * @brief
+     * A sampling engine maps random bits to the slot of an element. `RandomWeightedObjectGenerator` keeps the weight
+     * of every element in a dense array indexed by slot and hands it to the engine through `build()` on the first draw
+     * after a change, or when `update()` is called. Every engine provides:
+     * 
+     * `build(weights, total, threads)` - rebuilds the engine from the weight of each slot and their sum, on `threads`
+     * threads or one per core if it is 0. The result is the same for any number of threads;
+     * 
+     * `total()` - the total weight the engine was built with;
+     * 
+     * `draw(rng)` - returns the slot of a random element. Only valid if `total()` is not zero;
+     * 
+     * `incremental` - if `true`, the engine is told about every weight change through `set(slot, prev_weight, weight)`
+     * instead, where `slot` is either an existing slot or the next new one, and it is never rebuilt.
+     * 
+     * `CdfSampler` is the default engine: a prefix-sum array searched with `std::upper_bound`, O(log n) per draw. Its
+     * prefix sums are computed in parallel blocks.
+     */
+    class CdfSampler {
+    private:
+        vector<uint> _cdf;
+
+    public:
+        static constexpr bool incremental = false;
+
+        void build(const vector<uint> &weights, uint total, unsigned threads = 1){
+            _cdf.resize(weights.size());
+            detail::parallelPrefixSum(weights.begin(), weights.size(), _cdf.begin(), threads);
+            if(total == 0)
+                _cdf.clear();
+        }
+
+        uint total() const {
+            return _cdf.empty() ? 0 : _cdf.back();
+        }
+
+        template<typename URBG>
+        uint draw(URBG &rng) const {
+            uint random = detail::bounded(rng, _cdf.back());
+            return upper_bound(_cdf.begin(), _cdf.end(), random) - _cdf.begin();
+        }
+    };
+
+    /**
+     * @brief
+     * Walker's alias method. Every slot owns a column holding a threshold and an alias; a draw picks a column from the
+     * high 32 bits of one 64-bit random number and compares the low 32 bits against the threshold, so it costs O(1)
+     * no matter how many elements there are. `build()` is O(n).
+     * 
+     * The table is the one the sweeping construction of Huebschle-Schneider and Sanders makes: the light slots in
+     * order take what they lack from the heavy slots in order, and a heavy slot that runs out is topped up by the next
+     * heavy one. Every column follows from the prefix sums of what the light slots lack and the heavy slots spare, so
+     * the slots are partitioned, summed and paired in parallel blocks. On one thread the same table comes from a
+     * single sweep over the slots that keeps only the running sums. The arithmetic is exact integer arithmetic; only
+     * the final thresholds are rounded to 32-bit fixed point.
+     */
+    class AliasSampler {
+    private:
+        struct Column {
+            uint32_t threshold;
+            uint32_t alias;
+        };
+
+        vector<Column> _table;
+        uint _total = 0;
+
+        // The sweep itself: `served` is what the lights so far lack, `covered` what the heavies up to `h` spare, and a
+        // heavy runs out as soon as `covered` falls behind.
+        void sweep(const vector<uint> &weights, uint total){
+            size_t n = weights.size();
+            auto scaled = [&weights, n](size_t i){
+                return (uint64_t) weights[i] * n;
+            };
+            auto nextHeavy = [&scaled, total](size_t i){
+                while(scaled(i) < total)
+                    ++i;
+                return i;
+            };
+            size_t h = nextHeavy(0);
+            uint64_t covered = scaled(h) - total, served = 0;
+            for(size_t i = 0; i < n; ++i){
+                if(scaled(i) >= total)
+                    continue;
+                _table[i] = {(uint32_t) ((scaled(i) << 32) / total), (uint32_t) h};
+                served += total - scaled(i);
+                while(covered < served){
+                    size_t next = nextHeavy(h + 1);
+                    uint64_t left = total + covered - served;
+                    _table[h] = {(uint32_t) ((left << 32) / total), (uint32_t) next};
+                    h = next;
+                    covered += scaled(h) - total;
+                }
+            }
+            for(size_t i = h; i < n; ++i){
+                if(scaled(i) >= total)
+                    _table[i] = {UINT32_MAX, (uint32_t) i};
+            }
+        }
+
+    public:
+        static constexpr bool incremental = false;
+
+        void build(const vector<uint> &weights, uint total, unsigned threads = 1){
+            _table.clear();
+            _total = total;
+            if(total == 0)
+                return;
+
+            // Every weight is scaled by n so that each column holds exactly `total`.
+            size_t n = weights.size();
+            _table.resize(n);
+            if(threads == 1){
+                sweep(weights, total);
+                return;
+            }
+            auto scaled = [&weights, n](size_t i){
+                return (uint64_t) weights[i] * n;
+            };
+            vector<uint32_t> light, heavy;
+            auto isLight = [&scaled, total](size_t i){
+                return scaled(i) < total;
+            };
+            detail::parallelPartition(n, threads, isLight, light, heavy);
+
+            // `lacking[k]` is what lights 0..k lack together, `spare[m]` what heavies 0..m spare. Both end at the same
+            // sum.
+            vector<uint64_t> lacking(light.size()), spare(heavy.size());
+            detail::parallelBlocks(light.size(), threads, [&](size_t begin, size_t end){
+                for(size_t k = begin; k < end; ++k)
+                    lacking[k] = total - scaled(light[k]);
+            });
+            detail::parallelBlocks(heavy.size(), threads, [&](size_t begin, size_t end){
+                for(size_t m = begin; m < end; ++m)
+                    spare[m] = scaled(heavy[m]) - total;
+            });
+            detail::parallelPrefixSum(lacking.begin(), lacking.size(), lacking.begin(), threads);
+            detail::parallelPrefixSum(spare.begin(), spare.size(), spare.begin(), threads);
+
+            // Light k is filled by the heavy that is current once the lights before it are served: the first one whose
+            // cumulative spare covers them.
+            detail::parallelBlocks(light.size(), threads, [&](size_t begin, size_t end){
+                uint64_t before = begin == 0 ? 0 : lacking[begin - 1];
+                size_t m = lower_bound(spare.begin(), spare.end(), before) - spare.begin();
+                for(size_t k = begin; k < end; ++k){
+                    while(spare[m] < before)
+                        ++m;
+                    _table[light[k]] = {(uint32_t) ((scaled(light[k]) << 32) / total), heavy[m]};
+                    before = lacking[k];
+                }
+            });
+            // Heavy m runs out when the lights served so far first lack more than its cumulative spare. What it has
+            // left stays in its column and the next heavy fills the rest; a heavy that never runs out fills its own.
+            detail::parallelBlocks(heavy.size(), threads, [&](size_t begin, size_t end){
+                size_t k = upper_bound(lacking.begin(), lacking.end(), spare[begin]) - lacking.begin();
+                for(size_t m = begin; m < end; ++m){
+                    while(k < lacking.size() && lacking[k] <= spare[m])
+                        ++k;
+                    if(k == lacking.size()){
+                        _table[heavy[m]] = {UINT32_MAX, heavy[m]};
+                        continue;
+                    }
+                    uint64_t left = total + spare[m] - lacking[k];
+                    _table[heavy[m]] = {(uint32_t) ((left << 32) / total), heavy[m + 1]};
+                }
+            });
+        }
+
+        uint total() const {
+            return _total;
+        }
+
+        template<typename URBG>
+        uint draw(URBG &rng) const {
+            uint64_t random = detail::random64(rng);
+            uint32_t index = ((random >> 32) * _table.size()) >> 32;
+            const Column &column = _table[index];
+            return (uint32_t) random < column.threshold ? index : column.alias;
+        }
+    };
+
+    /**
+     * @brief
+     * A binary indexed (Fenwick) tree over the slots. `insert()`, `erase()` and `modify()` update it in O(log n) and a
+     * draw descends the tree in O(log n), so it never needs `update()`.
+     */
+    class FenwickSampler {
+    private:
+        // 1-based; `_tree[i]` holds the sum of slots `(i - lowbit(i), i]`.
+        vector<uint> _tree = vector<uint>(1);
+        uint _total = 0;
+
+        uint prefix(size_t count) const {
+            uint sum = 0;
+            for(; count > 0; count &= count - 1)
+                sum += _tree[count];
+            return sum;
+        }
+
+    public:
+        static constexpr bool incremental = true;
+
+        void build(const vector<uint> &weights, uint total, unsigned = 1){
+            size_t n = weights.size();
+            _tree.assign(n + 1, 0);
+            for(size_t i = 1; i <= n; ++i){
+                _tree[i] += weights[i - 1];
+                size_t parent = i + (i & (~i + 1));
+                if(parent <= n)
+                    _tree[parent] += _tree[i];
+            }
+            _total = total;
+        }
+
+        void set(uint slot, uint prev_weight, uint weight){
+            size_t i = (size_t) slot + 1;
+            if(i == _tree.size()){
+                // A new slot covers itself and the `lowbit(i) - 1` slots before it.
+                _tree.push_back(weight + prefix(i - 1) - prefix(i - (i & (~i + 1))));
+            }
+            else{
+                uint delta = weight - prev_weight;
+                for(; i < _tree.size(); i += i & (~i + 1))
+                    _tree[i] += delta;
+            }
+            _total += weight - prev_weight;
+        }
+
+        uint total() const {
+            return _total;
+        }
+
+        template<typename URBG>
+        uint draw(URBG &rng) const {
+            uint random = detail::bounded(rng, _total);
+            size_t n = _tree.size() - 1;
+            size_t step = 1;
+            while(step * 2 <= n)
+                step *= 2;
+
+            size_t pos = 0;
+            for(; step > 0; step >>= 1){
+                if(pos + step <= n && _tree[pos + step] <= random){
+                    pos += step;
+                    random -= _tree[pos];
+                }
+            }
+            return pos;
+        }
+    };
+
+    /**
+     * @brief
+     * A prefix-sum array over the slots with a positive weight, stored in Eytzinger (BFS) order. A draw walks down the
+     * implicit tree with a branchless loop and prefetches the grandchildren 4 levels ahead, so a search touches about
+     * one cache line per 4 levels instead of one per level as `std::upper_bound` does. Used by `freeze()`. The slots
+     * are compacted and summed in parallel blocks, and every block writes its nodes straight to their BFS positions.
+     */
+    class EytzingerSampler {
+    private:
+        // 1-based; `_slots[k]` is the slot whose cumulative weight is `_cdf[k]`.
+        vector<uint> _cdf;
+        vector<uint> _slots;
+        uint _total = 0;
+
+        // The BFS position of the node with in-order rank `rank` in a complete tree of `n` nodes and `levels` levels.
+        // The rank becomes the in-order position `i` in the perfect tree of that height, skipping the leaves missing
+        // from the last level, which holds `last` nodes. Node `i` of a perfect tree sits `ctz(i)` levels above the
+        // bottom.
+        static size_t bfsIndex(size_t rank, size_t n, unsigned levels){
+            size_t last = n - (((size_t) 1 << (levels - 1)) - 1);
+            uint64_t i = rank < 2 * last ? rank + 1 : 2 * (rank - last + 1);
+            unsigned height = detail::countTrailingZeros(i);
+            return ((size_t) 1 << (levels - 1 - height)) + (i >> (height + 1));
+        }
+
+    public:
+        static constexpr bool incremental = false;
+
+        void build(const vector<uint> &weights, uint total, unsigned threads = 1){
+            auto positive = [&weights](size_t i){
+                return weights[i] != 0;
+            };
+            vector<uint32_t> slots, empty;
+            detail::parallelPartition(weights.size(), threads, positive, slots, empty);
+            empty = vector<uint32_t>();
+
+            size_t n = slots.size();
+            vector<uint> cdf(n);
+            detail::parallelBlocks(n, threads, [&](size_t begin, size_t end){
+                for(size_t k = begin; k < end; ++k)
+                    cdf[k] = weights[slots[k]];
+            });
+            detail::parallelPrefixSum(cdf.begin(), n, cdf.begin(), threads);
+
+            _cdf.assign(n + 1, 0);
+            _slots.assign(n + 1, 0);
+            if(n > 0){
+                unsigned levels = 64 - detail::countLeadingZeros(n);
+                detail::parallelBlocks(n, threads, [&](size_t begin, size_t end){
+                    for(size_t rank = begin; rank < end; ++rank){
+                        size_t k = bfsIndex(rank, n, levels);
+                        _cdf[k] = cdf[rank];
+                        _slots[k] = slots[rank];
+                    }
+                });
+            }
+            _total = total;
+        }
+
+        uint total() const {
+            return _total;
+        }
+
+        template<typename URBG>
+        uint draw(URBG &rng) const {
+            uint random = detail::bounded(rng, _total);
+            const uint *cdf = _cdf.data();
+            size_t n = _cdf.size() - 1;
+            size_t k = 1;
+            while(k <= n){
+#if defined(__GNUC__)
+                __builtin_prefetch(cdf + 16 * k);
+#endif
+                k = 2 * k + (cdf[k] <= random);
+            }
+            // Strip the right turns taken after the last left turn; that node holds the first sum above `random`.
+            k >>= detail::countTrailingZeros(~(uint64_t) k) + 1;
+            return _slots[k];
+        }
+    };
+
+    /**
+     * @brief
+     * Inverse-CDF sampling accelerated by a guide table (Chen and Asau). The range of the random number is split into
+     * one bucket per slot, and each bucket remembers the first slot that can answer for it, so a draw costs O(1) on
+     * average. Building it is a single O(n) pass, cheaper than an alias table. The chosen slot never decreases as
+     * the random number grows, which keeps common random numbers monotone across distributions. The prefix sums and
+     * the guide table are both built in parallel blocks.
+     */
+    class GuideTableSampler {
+    private:
+        vector<uint> _cdf;
+        vector<uint> _guide;
+
+    public:
+        static constexpr bool incremental = false;
+
+        void build(const vector<uint> &weights, uint total, unsigned threads = 1){
+            _cdf.resize(weights.size());
+            detail::parallelPrefixSum(weights.begin(), weights.size(), _cdf.begin(), threads);
+            _guide.clear();
+            if(total == 0){
+                _cdf.clear();
+                return;
+            }
+
+            // Bucket j starts at floor(j * total / m); guide it to the first slot whose sum exceeds that.
+            size_t m = _cdf.size();
+            _guide.resize(m);
+            detail::parallelBlocks(m, threads, [&](size_t begin, size_t end){
+                size_t i = upper_bound(_cdf.begin(), _cdf.end(), (uint) ((uint64_t) begin * total / m)) - _cdf.begin();
+                for(size_t j = begin; j < end; ++j){
+                    uint start = (uint64_t) j * total / m;
+                    while(_cdf[i] <= start)
+                        ++i;
+                    _guide[j] = i;
+                }
+            });
+        }
+
+        uint total() const {
+            return _cdf.empty() ? 0 : _cdf.back();
+        }
+
+        template<typename URBG>
+        uint draw(URBG &rng) const {
+            uint64_t random = detail::random64(rng);
+            uint target = detail::scale(random, _cdf.back());
+            uint i = _guide[detail::scale(random, _guide.size())];
+            while(_cdf[i] <= target)
+                ++i;
+            return i;
+        }
+    };
+
+    /**
+     * @brief
+     * Groups the slots into weight classes `[2^k, 2^(k+1))`, in the spirit of Matias, Vitter and Ni. A draw picks a
+     * class by its total weight, then picks a uniform member of that class and accepts it with probability
+     * `weight / 2^(k+1)`, which is at least 1/2. `insert()`, `erase()` and `modify()` cost O(1) and a draw costs O(1)
+     * expected, so it never needs `update()`.
+     */
+    class BucketSampler {
+    private:
+        struct Bucket {
+            vector<uint> slots;
+            uint total = 0;
+        };
+
+        array<Bucket, 32> _buckets;
+        // Indexed by slot; `_positions` is the slot's index in the `slots` of its class.
+        vector<uint> _weights;
+        vector<uint> _positions;
+        uint _total = 0;
+
+        static unsigned weightClass(uint weight){
+#if defined(__GNUC__)
+            return 31 - __builtin_clz(weight);
+#else
+            unsigned k = 0;
+            while(weight >>= 1)
+                ++k;
+            return k;
+#endif
+        }
+
+        void add(uint slot, uint weight){
+            if(weight == 0)
+                return;
+            Bucket &bucket = _buckets[weightClass(weight)];
+            _positions[slot] = bucket.slots.size();
+            bucket.slots.push_back(slot);
+            bucket.total += weight;
+        }
+
+        void remove(uint slot, uint weight){
+            if(weight == 0)
+                return;
+            Bucket &bucket = _buckets[weightClass(weight)];
+            uint last = bucket.slots.back();
+            bucket.slots[_positions[slot]] = last;
+            _positions[last] = _positions[slot];
+            bucket.slots.pop_back();
+            bucket.total -= weight;
+        }
+
+    public:
+        static constexpr bool incremental = true;
+
+        void build(const vector<uint> &weights, uint total, unsigned = 1){
+            _buckets = {};
+            _weights = weights;
+            _positions.assign(weights.size(), 0);
+            for(size_t i = 0; i < weights.size(); ++i)
+                add(i, weights[i]);
+            _total = total;
+        }
+
+        void set(uint slot, uint prev_weight, uint weight){
+            if(slot == _weights.size()){
+                _weights.push_back(0);
+                _positions.push_back(0);
+            }
+            if(prev_weight != 0 && weight != 0 && weightClass(prev_weight) == weightClass(weight)){
+                _buckets[weightClass(weight)].total += weight - prev_weight;
+            }
+            else{
+                remove(slot, prev_weight);
+                add(slot, weight);
+            }
+            _weights[slot] = weight;
+            _total += weight - prev_weight;
+        }
+
+        uint total() const {
+            return _total;
+        }
+
+        template<typename URBG>
+        uint draw(URBG &rng) const {
+            uint random = detail::bounded(rng, _total);
+            unsigned k = 31;
+            while(random >= _buckets[k].total){
+                random -= _buckets[k].total;
+                --k;
+            }
+
+            const vector<uint> &slots = _buckets[k].slots;
+            while(true){
+                uint64_t bits = detail::random64(rng);
+                uint slot = slots[((bits >> 32) * slots.size()) >> 32];
+                // The top k + 1 bits of the low half are uniform in [0, 2^(k+1)).
+                if(((uint32_t) bits >> (31 - k)) < _weights[slot])
+                    return slot;
+            }
+        }
+    };
+
+    /**
+     * @brief
+     * An index maps elements to their slots for `RandomWeightedObjectGenerator`, which owns the elements and passes
+     * them in. Every index provides `find(elements, key)`, `insert(elements, slot)` for an element that is not in it
+     * yet, `erase(elements, key)`, `clear()` and `size()`. `find()` and `erase()` return the slot or `detail::npos`.
+     * For batches it also provides `findMany(elements, keys)`, which returns the slot or `detail::npos` of every key,
+     * `insertMany(elements, slots)`, which inserts them all or, if two of them hold equal elements, none and returns
+     * `false`, and `eraseMany(elements, slots)` for slots that are in it, which are not looked up by element again.
+     * 
+     * `OrderedIndex` is the default index: a treap of slots ordered by element, whose priorities are a hash of the
+     * slot. It needs `E < E`, costs two 4-byte children per slot, and `find()`, `insert()` and `erase()` take O(log n)
+     * expected time.
+     */
+    class OrderedIndex {
+    private:
+        struct Node {
+            uint left = detail::npos;
+            uint right = detail::npos;
+        };
+
+        // A treap of slots: in order by element, and a max-heap on a hash of the slot, which keeps it balanced in
+        // expectation without storing priorities. The children are indexed by slot and kept side by side, so a step
+        // down touches one cache line besides the element.
+        vector<Node> _nodes;
+        uint _root = detail::npos;
+        size_t _size = 0;
+
+        static uint64_t priority(uint slot){
+            // SplitMix64 is a bijection, so no two slots tie.
+            return SplitMix64(slot)();
+        }
+
+        // Splits the subtree at `node` into the slots before and after `elements[slot]`, which is not in it.
+        template<typename E>
+        void split(const vector<E> &elements, uint node, uint slot, uint &before, uint &after){
+            uint *low = &before;
+            uint *high = &after;
+            while(node != detail::npos){
+                if(elements[node] < elements[slot]){
+                    *low = node;
+                    low = &_nodes[node].right;
+                    node = _nodes[node].right;
+                }
+                else{
+                    *high = node;
+                    high = &_nodes[node].left;
+                    node = _nodes[node].left;
+                }
+            }
+            *low = detail::npos;
+            *high = detail::npos;
+        }
+
+        // Joins two subtrees, every slot of `low` ordered before every slot of `high`.
+        uint join(uint low, uint high){
+            uint root = detail::npos;
+            uint *link = &root;
+            while(low != detail::npos && high != detail::npos){
+                if(priority(low) > priority(high)){
+                    *link = low;
+                    link = &_nodes[low].right;
+                    low = _nodes[low].right;
+                }
+                else{
+                    *link = high;
+                    link = &_nodes[high].left;
+                    high = _nodes[high].left;
+                }
+            }
+            *link = low != detail::npos ? low : high;
+            return root;
+        }
+
+        // Merges the subtree `other`, whose elements are all new, into the subtree at `node` and returns its root. The
+        // root with the higher priority splits the other subtree around itself, so only the paths between the new
+        // slots are walked: O(m log(n / m)) expected for m new slots.
+        template<typename E>
+        uint unite(const vector<E> &elements, uint node, uint other){
+            if(node == detail::npos)
+                return other;
+            if(other == detail::npos)
+                return node;
+            if(priority(node) < priority(other))
+                swap(node, other);
+            uint before, after;
+            split(elements, other, node, before, after);
+            _nodes[node].left = unite(elements, _nodes[node].left, before);
+            _nodes[node].right = unite(elements, _nodes[node].right, after);
+            return node;
+        }
+
+        // Removes the slots in `[first, last)`, ordered by element and all in the subtree at `node`, in one walk and
+        // returns its new root.
+        template<typename E>
+        uint eraseSorted(const vector<E> &elements, uint node, const uint *first, const uint *last){
+            if(first == last)
+                return node;
+            const uint *middle = partition_point(first, last, [&elements, node](uint slot){
+                return elements[slot] < elements[node];
+            });
+            bool found = middle != last && *middle == node;
+            uint left = eraseSorted(elements, _nodes[node].left, first, middle);
+            uint right = eraseSorted(elements, _nodes[node].right, middle + found, last);
+            if(!found){
+                _nodes[node].left = left;
+                _nodes[node].right = right;
+                return node;
+            }
+            _nodes[node].left = _nodes[node].right = detail::npos;
+            return join(left, right);
+        }
+
+        // Writes the slot of the keys `keys[*first..*last)`, ordered by element, that are in the subtree at `node`.
+        // Neighbouring keys share most of their path, so it is walked once for all of them.
+        template<typename E>
+        void findSorted(const vector<E> &elements, const vector<const E*> &keys, uint node, const uint *first,
+            const uint *last, vector<uint> &slots) const {
+            if(node == detail::npos || first == last)
+                return;
+            const uint *low = partition_point(first, last, [&](uint i){
+                return *keys[i] < elements[node];
+            });
+            const uint *high = partition_point(low, last, [&](uint i){
+                return !(elements[node] < *keys[i]);
+            });
+            for(const uint *i = low; i != high; ++i)
+                slots[*i] = node;
+            findSorted(elements, keys, _nodes[node].left, first, low, slots);
+            findSorted(elements, keys, _nodes[node].right, high, last, slots);
+        }
+
+        // Builds a treap from slots in order in one pass, keeping the right spine on a stack, and returns its root.
+        uint build(const vector<uint> &order){
+            vector<uint> spine;
+            for(uint slot : order){
+                uint last = detail::npos;
+                while(!spine.empty() && priority(spine.back()) < priority(slot)){
+                    last = spine.back();
+                    spine.pop_back();
+                }
+                _nodes[slot].left = last;
+                _nodes[slot].right = detail::npos;
+                if(!spine.empty())
+                    _nodes[spine.back()].right = slot;
+                spine.push_back(slot);
+            }
+            return spine.empty() ? detail::npos : spine.front();
+        }
+
+        void reserve(size_t slots){
+            if(_nodes.size() < slots)
+                _nodes.resize(slots);
+        }
+
+    public:
+        size_t size() const {
+            return _size;
+        }
+
+        void clear(){
+            _nodes.clear();
+            _root = detail::npos;
+            _size = 0;
+        }
+
+        template<typename E, typename K>
+        uint find(const vector<E> &elements, const K &key) const {
+            uint node = _root;
+            while(node != detail::npos){
+                if(key < elements[node])
+                    node = _nodes[node].left;
+                else if(elements[node] < key)
+                    node = _nodes[node].right;
+                else
+                    return node;
+            }
+            return detail::npos;
+        }
+
+        template<typename E>
+        void insert(const vector<E> &elements, uint slot){
+            reserve(elements.size());
+            uint64_t p = priority(slot);
+            uint *link = &_root;
+            while(*link != detail::npos && priority(*link) > p)
+                link = elements[slot] < elements[*link] ? &_nodes[*link].left : &_nodes[*link].right;
+            split(elements, *link, slot, _nodes[slot].left, _nodes[slot].right);
+            *link = slot;
+            ++_size;
+        }
+
+        template<typename E, typename K>
+        uint erase(const vector<E> &elements, const K &key){
+            uint *link = &_root;
+            while(*link != detail::npos){
+                uint node = *link;
+                if(key < elements[node]){
+                    link = &_nodes[node].left;
+                }
+                else if(elements[node] < key){
+                    link = &_nodes[node].right;
+                }
+                else{
+                    *link = join(_nodes[node].left, _nodes[node].right);
+                    _nodes[node].left = _nodes[node].right = detail::npos;
+                    --_size;
+                    return node;
+                }
+            }
+            return detail::npos;
+        }
+
+        // The keys are sorted once and looked up in one walk of the treap.
+        template<typename E>
+        vector<uint> findMany(const vector<E> &elements, const vector<const E*> &keys) const {
+            vector<uint> order(keys.size());
+            iota(order.begin(), order.end(), 0);
+            sort(order.begin(), order.end(), [&keys](uint a, uint b){
+                return *keys[a] < *keys[b];
+            });
+            vector<uint> slots(keys.size(), detail::npos);
+            findSorted(elements, keys, _root, order.data(), order.data() + order.size(), slots);
+            return slots;
+        }
+
+        // The new slots are sorted, built into a treap of their own in one pass, and merged into this one.
+        template<typename E>
+        bool insertMany(const vector<E> &elements, vector<uint> slots){
+            auto less = [&elements](uint a, uint b){
+                return elements[a] < elements[b];
+            };
+            sort(slots.begin(), slots.end(), less);
+            if(adjacent_find(slots.begin(), slots.end(), [&less](uint a, uint b){ return !less(a, b); }) != slots.end())
+                return false;
+            reserve(elements.size());
+            _root = unite(elements, _root, build(slots));
+            _size += slots.size();
+            return true;
+        }
+
+        template<typename E>
+        void eraseMany(const vector<E> &elements, vector<uint> slots){
+            sort(slots.begin(), slots.end(), [&elements](uint a, uint b){
+                return elements[a] < elements[b];
+            });
+            _root = eraseSorted(elements, _root, slots.data(), slots.data() + slots.size());
+            _size -= slots.size();
+        }
+    };
+
+    /**
+     * @brief
+     * An open-addressing hash index in the style of Swiss tables. Every bucket has a control byte holding 7 bits of
+     * the hash, and a probe compares a group of 8 control bytes at once, so `find()`, `insert()` and `erase()` cost
+     * O(1) on average and usually touch one group and one element. It needs `std::hash<E>` and `E == E` instead of
+     * `E < E`. `string_view` and `const char*` keys are hashed like `string` without constructing one.
+     */
+    class HashIndex {
+    private:
+        static constexpr uint8_t empty = 0x80;
+        static constexpr uint8_t deleted = 0xFE;
+        static constexpr uint64_t lsbs = 0x0101010101010101;
+        static constexpr uint64_t msbs = 0x8080808080808080;
+
+        // Control bytes: `empty`, `deleted`, or the low 7 bits of the hash of the element in `_slots`.
+        vector<uint8_t> _control;
+        vector<uint> _slots;
+        size_t _size = 0;
+        size_t _tombstones = 0;
+
+        template<typename E, typename K>
+        static uint64_t hashOf(const K &key){
+            size_t h;
+            if constexpr(is_same_v<E, K>)
+                h = hash<E>{}(key);
+            else if constexpr(is_same_v<E, string> && is_convertible_v<const K&, string_view>)
+                h = hash<string_view>{}(key);
+            else
+                h = hash<E>{}(E(key));
+            // `std::hash` is often the identity; spread it over all the bits.
+            uint64_t mixed = (uint64_t) h * 0x9e3779b97f4a7c15;
+            return mixed ^ (mixed >> 32);
+        }
+
+        uint64_t group(size_t g) const {
+            uint64_t word;
+            memcpy(&word, &_control[g * 8], 8);
+            return word;
+        }
+
+        // The high bit of every byte of `word` that equals `byte`.
+        static uint64_t match(uint64_t word, uint8_t byte){
+            uint64_t x = word ^ (lsbs * byte);
+            return ~(((x & ~msbs) + ~msbs) | x | ~msbs);
+        }
+
+        static uint64_t matchEmpty(uint64_t word){
+            return word & ~(word << 6) & msbs;
+        }
+
+        template<typename E, typename K>
+        size_t findBucket(const vector<E> &elements, const K &key) const {
+            if(_size == 0)
+                return SIZE_MAX;
+            return probe(hashOf<E>(key), [&elements, &key](uint slot){
+                return elements[slot] == key;
+            });
+        }
+
+        // The bucket on the probe sequence of `h` whose slot satisfies `matches`, or `SIZE_MAX`.
+        template<typename F>
+        size_t probe(uint64_t h, F matches) const {
+            size_t mask = _control.size() / 8 - 1;
+            size_t g = (h >> 7) & mask;
+            for(size_t step = 1; ; ++step){
+                uint64_t word = group(g);
+                for(uint64_t m = match(word, h & 0x7F); m != 0; m &= m - 1){
+                    size_t bucket = g * 8 + detail::countTrailingZeros(m) / 8;
+                    if(matches(_slots[bucket]))
+                        return bucket;
+                }
+                if(matchEmpty(word) != 0)
+                    return SIZE_MAX;
+                g = (g + step) & mask;
+            }
+        }
+
+        void place(uint64_t h, uint slot){
+            size_t mask = _control.size() / 8 - 1;
+            size_t g = (h >> 7) & mask;
+            for(size_t step = 1; ; ++step){
+                uint64_t free = group(g) & msbs;
+                if(free != 0){
+                    size_t bucket = g * 8 + detail::countTrailingZeros(free) / 8;
+                    if(_control[bucket] == deleted)
+                        --_tombstones;
+                    _control[bucket] = h & 0x7F;
+                    _slots[bucket] = slot;
+                    ++_size;
+                    return;
+                }
+                g = (g + step) & mask;
+            }
+        }
+
+        // Inserts `slot` unless an equal element is in already. The probe that looks for it also remembers the first
+        // free bucket, where `place()` would put it.
+        template<typename E>
+        bool insertUnique(const vector<E> &elements, uint slot){
+            if((_size + _tombstones + 1) * 8 > _control.size() * 7)
+                rehash(elements);
+            uint64_t h = hashOf<E>(elements[slot]);
+            size_t mask = _control.size() / 8 - 1;
+            size_t g = (h >> 7) & mask;
+            size_t target = SIZE_MAX;
+            for(size_t step = 1; ; ++step){
+                uint64_t word = group(g);
+                for(uint64_t m = match(word, h & 0x7F); m != 0; m &= m - 1){
+                    size_t bucket = g * 8 + detail::countTrailingZeros(m) / 8;
+                    if(elements[_slots[bucket]] == elements[slot])
+                        return false;
+                }
+                uint64_t free = word & msbs;
+                if(target == SIZE_MAX && free != 0)
+                    target = g * 8 + detail::countTrailingZeros(free) / 8;
+                if(matchEmpty(word) != 0)
+                    break;
+                g = (g + step) & mask;
+            }
+            if(_control[target] == deleted)
+                --_tombstones;
+            _control[target] = h & 0x7F;
+            _slots[target] = slot;
+            ++_size;
+            return true;
+        }
+
+        template<typename E>
+        void rehash(const vector<E> &elements){
+            size_t capacity = 16;
+            while(capacity * 7 < (_size + 1) * 16)
+                capacity *= 2;
+
+            vector<uint8_t> control(capacity, empty);
+            vector<uint> slots(capacity);
+            control.swap(_control);
+            slots.swap(_slots);
+            _size = 0;
+            _tombstones = 0;
+            for(size_t bucket = 0; bucket < control.size(); ++bucket){
+                if(!(control[bucket] & 0x80))
+                    place(hashOf<E>(elements[slots[bucket]]), slots[bucket]);
+            }
+        }
+
+    public:
+        size_t size() const {
+            return _size;
+        }
+
+        void clear(){
+            _control.clear();
+            _slots.clear();
+            _size = 0;
+            _tombstones = 0;
+        }
+
+        template<typename E, typename K>
+        uint find(const vector<E> &elements, const K &key) const {
+            size_t bucket = findBucket(elements, key);
+            return bucket == SIZE_MAX ? detail::npos : _slots[bucket];
+        }
+
+        template<typename E>
+        void insert(const vector<E> &elements, uint slot){
+            // Keep at most 7/8 of the buckets in use, tombstones included.
+            if((_size + _tombstones + 1) * 8 > _control.size() * 7)
+                rehash(elements);
+            place(hashOf<E>(elements[slot]), slot);
+        }
+
+        template<typename E, typename K>
+        uint erase(const vector<E> &elements, const K &key){
+            size_t bucket = findBucket(elements, key);
+            if(bucket == SIZE_MAX)
+                return detail::npos;
+            _control[bucket] = deleted;
+            ++_tombstones;
+            --_size;
+            return _slots[bucket];
+        }
+
+        // The lookups are independent and O(1) each, so they are simply made one after another.
+        template<typename E>
+        vector<uint> findMany(const vector<E> &elements, const vector<const E*> &keys) const {
+            vector<uint> slots(keys.size());
+            for(size_t i = 0; i < keys.size(); i++)
+                slots[i] = find(elements, *keys[i]);
+            return slots;
+        }
+
+        template<typename E>
+        bool insertMany(const vector<E> &elements, const vector<uint> &slots){
+            for(size_t i = 0; i < slots.size(); i++){
+                if(!insertUnique(elements, slots[i])){
+                    while(i > 0)
+                        erase(elements, elements[slots[--i]]);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // The slots are known, so the probes compare slots instead of elements.
+        template<typename E>
+        void eraseMany(const vector<E> &elements, const vector<uint> &slots){
+            for(uint slot : slots){
+                size_t bucket = probe(hashOf<E>(elements[slot]), [slot](uint other){
+                    return other == slot;
+                });
+                _control[bucket] = deleted;
+                ++_tombstones;
+                --_size;
+            }
+        }
+    };
+
+    /**
+     * @author dzunni
+     * @version 1.0
+     * @brief
+     * The `dzunni::RandomWeightedObjectGenerator` class is a container and a random object generator class that
+     * contains unique elements of type `E` and each element has a weight. `E` must be copyable and meet the
+     * requirements of the `Index`: ordered by `operator<` for the default `OrderedIndex`, or hashable and equality
+     * comparable for `HashIndex`. The weight is an unsigned integer that determines each element's probability which
+     * equals to the element's weight divided by the total weight of all elements.
+     * 
+     * The class uses the `URBG` engine for randomness, `Xoshiro256PlusPlus` by default. Any uniform random bit
+     * generator with a `seed()` that outputs every 32-bit or every 64-bit value works, e.g. `Pcg32` or `mt19937` from
+     * C++ standard library. Random numbers are bounded with Lemire's method instead of the standard distributions,
+     * so the same seed gives the same elements on every platform. That holds for the draws of the engines, which are
+     * integer arithmetic only. `sampleSorted()`, `sampleCounts()` and `sampleDistinct()` decide with `log()`, `log1p()`
+     * and `exp()` from the C library, which are not correctly rounded and differ between implementations, so they
+     * only replay on the same platform and standard library, as does `WeightedReservoir`.
+     * 
+     * How a random number is turned into an element is decided by the sampling engine `Sampler`: `CdfSampler` by
+     * default, `AliasSampler` for O(1) draws, `GuideTableSampler` for O(1) expected draws that stay monotone in the
+     * random number, `FenwickSampler` for O(log n) modifiers that never need a rebuild, or `BucketSampler` for O(1)
+     * modifiers and O(1) expected draws that never need a rebuild either.
+     * 
+     * The class needs a seed for the randomizer through its constructor. You can set a new seed by calling `seed()`.
+     * 
+     * The class offers modifiers: `insert()`, `erase()`, `modify()`, and `clear()`, which modifies the elements and
+     * their weight. The randomizer keeps track of them and rebuilds its engine once, on the first draw after a batch of
+     * changes, so a thousand calls to `modify()` followed by one draw cost one rebuild. Call `update()` to rebuild it
+     * right away instead, e.g. before handing the generator to other threads.
+     * 
+     * You can determine the container's information about itself:
+     * 
+     * `empty()` - if it is empty;
+     * 
+     * `size()` - the number of elements contained;
+     * 
+     * `totalWeight()` - the total weight of all elements;
+     * 
+     * `contains()` - if it contains a specified element;
+     * 
+     * Or about its elements:
+     * 
+     * `weight()` - the weight of the specified element;
+     * 
+     * `probability()` - the probability of the specified element.
+     * 
+     * Distributions that are built once and then only read can be frozen with `freeze()`, which turns them into a
+     * flat prefix-sum array searched in Eytzinger order. Any modifier thaws them again.
+     * 
+     * Finally, call its operator `operator()` to generate a random element. Additionally, you can call `sample()`
+     * to get a set amount of random elements.
+     * 
+     * Every inquiry and every overload that takes a randomizer, such as `operator()(rng)` and `sample(amount, rng)`, is
+     * `const` and leaves the elements untouched, so threads can share one generator, each drawing with its own
+     * randomizer, as long as nobody modifies it at the same time. The only lock is taken by the first draw after a
+     * change, which rebuilds the engine while the other threads wait for it.
+     * 
+     * The elements are kept in one contiguous array and their weights in another, both indexed by slot. `Index` maps
+     * elements to slots: `OrderedIndex`, a treap of slots ordered by element with O(log n) expected lookups, inserts
+     * and erases, or `HashIndex`, an open-addressing hash table with O(1) average lookups for keys without a
+     * meaningful order. The engines only ever read the packed weight array.
+     * 
+     * Note: Elements whose weight is zero can be contained but will never be picked by the randomizer.
+     */
+    template<typename E, typename Sampler = CdfSampler, typename URBG = Xoshiro256PlusPlus,
+        typename Index = OrderedIndex>
+    class RandomWeightedObjectGenerator{
+    private:
+        using uint = unsigned int;
+
+        // Static engines are rebuilt on the first draw after `_epoch` moves past `_built_epoch`.
+        static constexpr bool lazy = !Sampler::incremental;
+
+    public:
+        /**
+         * @brief The slot that `drawIndex()` returns if it is empty.
+         */
+        static constexpr uint npos = detail::npos;
+
+        /**
+         * @brief The number of draws that `parallelSample()` takes from one stream.
+         */
+        static constexpr size_t parallel_chunk = 1 << 16;
+
+    private:
+
+        URBG _rng;
+        uint64_t _seed = 0;
+        mutable Sampler _sampler;
+        mutable atomic<uint64_t> _built_epoch{0};
+        mutable mutex _build_mutex;
+        uint64_t _epoch = 0;
+        unsigned _build_threads = 1;
+        EytzingerSampler _frozen_sampler;
+        bool _frozen = false;
+        uint _total_weight = 0;
+
+        uint getTotalWeight() const {
+            return _total_weight;
+        }
+
+        template<typename K>
+        using EnableIfKey = enable_if_t<detail::IsKey<E, K>::value, int>;
+
+        // Structure of arrays indexed by slot. Erased elements leave a free slot with zero weight.
+        vector<E> _elements;
+        vector<uint> _weights;
+        vector<uint> _free_slots;
+        // Maps elements to slots.
+        Index _index;
+
+        template<typename K>
+        uint findSlot(const K &key) const {
+            return _index.find(_elements, key);
+        }
+
+        void build() const {
+            if constexpr(lazy){
+                if(_built_epoch.load(memory_order_acquire) == _epoch)
+                    return;
+                lock_guard<mutex> lock(_build_mutex);
+                if(_built_epoch.load(memory_order_relaxed) == _epoch)
+                    return;
+                _sampler.build(_weights, _total_weight, _build_threads);
+                _built_epoch.store(_epoch, memory_order_release);
+            }
+        }
+
+        // The randomizer of draw `index` of `stream` for `sampleAt()`. The sample sequence and the Philox counter name
+        // things differently, so spelled out from the high word down, the 128-bit counter is
+        //     [ index : 64 | stream : 32 | block : 32 ]
+        // The draw index fills what `Philox4x32` calls its stream, and the caller's stream is the high half of its
+        // block number, which leaves every draw 2^32 blocks of its own.
+        static Philox4x32 drawRandomizer(uint64_t seed, uint64_t index, uint32_t stream){
+            uint64_t philox_stream = index;
+            uint64_t first_block = (uint64_t) stream << 32;
+            Philox4x32 rng(seed, philox_stream);
+            rng.seek(first_block);
+            return rng;
+        }
+
+        uint drawSlotAt(uint64_t index, uint32_t stream) const noexcept(!lazy) {
+            Philox4x32 rng = drawRandomizer(_seed, index, stream);
+            return drawSlot(rng);
+        }
+
+        template<typename R>
+        uint drawSlot(R &rng) const noexcept(!lazy) {
+            if(_frozen)
+                return _frozen_sampler.total() == 0 ? detail::npos : _frozen_sampler.draw(rng);
+            build();
+            return _sampler.total() == 0 ? detail::npos : _sampler.draw(rng);
+        }
+
+        // Writes `amount` independent draws, each passed through `convert(slot)`. The engine is picked once, so the
+        // loop body is only the draw and the store. Writes nothing if it is empty.
+        template<typename R, typename OutputIt, typename F>
+        OutputIt drawMany(R &rng, size_t amount, OutputIt out, F convert) const {
+            auto fill = [&](const auto &sampler){
+                if(sampler.total() == 0)
+                    return;
+                for(; amount > 0; --amount, ++out)
+                    *out = convert(sampler.draw(rng));
+            };
+            if(_frozen){
+                fill(_frozen_sampler);
+            }
+            else{
+                build();
+                fill(_sampler);
+            }
+            return out;
+        }
+
+        uint acquireSlot(const E &element){
+            if(!_free_slots.empty()){
+                uint slot = _free_slots.back();
+                _free_slots.pop_back();
+                _elements[slot] = element;
+                return slot;
+            }
+            _elements.push_back(element);
+            _weights.push_back(0);
+            return _weights.size() - 1;
+        }
+
+        void releaseSlot(uint slot){
+            setWeight(slot, 0);
+            if constexpr(is_default_constructible_v<E>)
+                _elements[slot] = E();
+            _free_slots.push_back(slot);
+        }
+
+        void thaw(){
+            _frozen = false;
+            _frozen_sampler = EytzingerSampler();
+        }
+
+        void setWeight(uint slot, uint weight){
+            if(_frozen)
+                thaw();
+            uint prev_weight = _weights[slot];
+            ++_epoch;
+            _weights[slot] = weight;
+            _total_weight = _total_weight - prev_weight + weight;
+            if constexpr(Sampler::incremental)
+                _sampler.set(slot, prev_weight, weight);
+        }
+
+    public:
+        /**
+         * @brief Refers to an element by its slot, so that the overloads taking it skip the lookup. It stays valid
+         * until that element is erased or the generator is cleared.
+         */
+        class Handle {
+        private:
+            uint _slot;
+
+        public:
+            explicit Handle(uint slot) : _slot(slot) {}
+
+            /**
+             * @brief Returns the slot of the element.
+             */
+            uint index() const {
+                return _slot;
+            }
+
+            bool operator==(const Handle &other) const {
+                return _slot == other._slot;
+            }
+
+            bool operator!=(const Handle &other) const {
+                return _slot != other._slot;
+            }
+        };
+
+        /**
+         * @brief A change for `apply()`: sets the weight of `element`, inserting it if it is not there yet, or erases
+         * it if `erase` is `true`.
+         */
+        struct Delta {
+            E element;
+            uint weight = 0;
+            bool erase = false;
+        };
+
+        RandomWeightedObjectGenerator(uint seed){
+            this->seed(seed);
+        }
+
+        /**
+         * @brief Copies everything but the state of the randomizer. Call `seed()` after copying.
+         */
+        RandomWeightedObjectGenerator(const RandomWeightedObjectGenerator &other){
+            _elements = other._elements;
+            _weights = other._weights;
+            _free_slots = other._free_slots;
+            _index = other._index;
+            _sampler = other._sampler;
+            _built_epoch = other._built_epoch.load();
+            _epoch = other._epoch;
+            _build_threads = other._build_threads;
+            _frozen_sampler = other._frozen_sampler;
+            _frozen = other._frozen;
+            _total_weight = other._total_weight;
+        }
+
+        RandomWeightedObjectGenerator(RandomWeightedObjectGenerator &&other){
+            _elements = move(other._elements);
+            _weights = move(other._weights);
+            _free_slots = move(other._free_slots);
+            _index = move(other._index);
+            _total_weight = other._total_weight;
+            _rng = move(other._rng);
+            _seed = other._seed;
+            _sampler = move(other._sampler);
+            _built_epoch = other._built_epoch.load();
+            _epoch = other._epoch;
+            _build_threads = other._build_threads;
+            _frozen_sampler = move(other._frozen_sampler);
+            _frozen = other._frozen;
+        }
+
+        /**
+         * @brief The seed for the randomizer.
+         */
+        void seed(uint seed){
+            _seed = seed;
+            _rng.seed(seed);
+        }
+
+        /**
+         * @brief Rebuilds the engine now if a modifier changed anything since the last build, instead of on the next
+         * draw. Does nothing for incremental engines such as `FenwickSampler` and `BucketSampler`.
+         */
+        void update(){
+            build();
+        }
+
+        /**
+         * @brief Sets how many threads rebuild the engine, or 0 for one per core. 1 by default. The tables come out the
+         * same for any number of threads; only distributions of millions of elements gain from more.
+         */
+        void buildThreads(unsigned threads){
+            _build_threads = threads;
+        }
+
+        /**
+         * @brief Returns how many threads rebuild the engine, 0 meaning one per core.
+         */
+        unsigned buildThreads() const {
+            return _build_threads;
+        }
+
+        /**
+         * @brief Builds a read-only prefix-sum array in Eytzinger order that `operator()` uses instead of the engine
+         * until the next call to a modifier. Meant for distributions that are built once and drawn from many times.
+         */
+        void freeze(){
+            _frozen_sampler.build(_weights, _total_weight, _build_threads);
+            _frozen = true;
+        }
+
+        /**
+         * @brief Determines if it is frozen.
+         */
+        bool frozen() const {
+            return _frozen;
+        }
+
+        /**
+         * Returns the number of elements.
+         */
+        size_t size() const {
+            return _index.size();
+        }
+
+        /**
+         * @brief Determines if it is empty.
+         */
+        bool empty() const {
+            return _index.size() == 0;
+        }
+
+        /**
+         * @brief Returns the total weight of all elements.
+         */
+        uint totalWeight() const {
+            return _total_weight;
+        }
+
+        /**
+         * @brief Determines if the element exists.
+         */
+        bool contains(const E& element) const {
+            return contains<E>(element);
+        }
+
+        /**
+         * @brief Determines if an element equal to the key exists, e.g. a `string_view` for `RwogString`, without
+         * constructing an `E`.
+         */
+        template<typename K, EnableIfKey<K> = 0>
+        bool contains(const K& key) const {
+            return findSlot(key) != detail::npos;
+        }
+
+        /**
+         * @brief Returns the weight of the element or `nullopt` if the element is not found.
+         */
+        optional<uint> weight(const E& element) const {
+            return weight<E>(element);
+        }
+
+        /**
+         * @brief Returns the weight of the element equal to the key or `nullopt` if it is not found.
+         */
+        template<typename K, EnableIfKey<K> = 0>
+        optional<uint> weight(const K& key) const {
+            uint slot = findSlot(key);
+            if(slot == detail::npos)
+                return nullopt;
+            return _weights[slot];
+        }
+
+        /**
+         * @brief Returns the probability of the element or `nullopt` if the element is not found.
+         */
+        optional<double> probability(const E& element) const {
+            return probability<E>(element);
+        }
+
+        /**
+         * @brief Returns the probability of the element equal to the key or `nullopt` if it is not found.
+         */
+        template<typename K, EnableIfKey<K> = 0>
+        optional<double> probability(const K& key) const {
+            uint slot = findSlot(key);
+            if(slot == detail::npos)
+                return nullopt;
+            return (double) _weights[slot] / _total_weight;
+        }
+
+        /**
+         * @brief Inserts an element with its weight.
+         * @return `true` - successfully added, `false` - there is already an identical element.
+         */
+        bool insert(const E &element, uint weight){
+            return emplace(element, weight).has_value();
+        }
+
+        /**
+         * @brief Inserts an element with its weight.
+         * @return The handle of the new element or `nullopt` if there is already an identical element.
+         */
+        optional<Handle> emplace(const E &element, uint weight){
+            if(findSlot(element) != detail::npos)
+                return nullopt;
+            
+            uint slot = acquireSlot(element);
+            _index.insert(_elements, slot);
+            setWeight(slot, weight);
+            return Handle(slot);
+        }
+
+        /**
+         * @brief Returns the handle of the element equal to the key or `nullopt` if it is not found.
+         */
+        template<typename K, EnableIfKey<K> = 0>
+        optional<Handle> find(const K& key) const {
+            uint slot = findSlot(key);
+            if(slot == detail::npos)
+                return nullopt;
+            return Handle(slot);
+        }
+
+        /**
+         * @brief Returns the handle of the element or `nullopt` if it is not found.
+         */
+        optional<Handle> find(const E& element) const {
+            return find<E>(element);
+        }
+
+        /**
+         * @brief Returns the element of a valid handle.
+         */
+        const E& element(Handle handle) const {
+            return _elements[handle.index()];
+        }
+
+        /**
+         * @brief Returns the weight of the element of a valid handle.
+         */
+        uint weight(Handle handle) const {
+            return _weights[handle.index()];
+        }
+
+        /**
+         * @brief Erases an element along with their weight.
+         * @return Returns the weight of the element or `nullopt` if the element is not found.
+         */
+        optional<uint> erase(const E &element){
+            return erase<E>(element);
+        }
+
+        /**
+         * @brief Erases the element equal to the key along with their weight.
+         * @return Returns the weight of the element or `nullopt` if the element is not found.
+         */
+        template<typename K, EnableIfKey<K> = 0>
+        optional<uint> erase(const K &key){
+            uint slot = _index.erase(_elements, key);
+            if(slot != detail::npos){
+                uint weight = _weights[slot];
+                releaseSlot(slot);
+                return weight;
+            }
+            return nullopt;
+        }
+
+        /**
+         * @brief Erases the element of a valid handle, which becomes invalid.
+         * @return Returns the weight of the element.
+         */
+        uint erase(Handle handle){
+            uint slot = handle.index();
+            uint weight = _weights[slot];
+            _index.erase(_elements, _elements[slot]);
+            releaseSlot(slot);
+            return weight;
+        }
+
+        /**
+         * @brief Clears the set and the total weight.
+         */
+        void clear(){
+            _elements.clear();
+            _weights.clear();
+            _free_slots.clear();
+            _index.clear();
+            _sampler = Sampler();
+            ++_epoch;
+            thaw();
+            _total_weight = 0;
+        }
+
+        /**
+         * @brief Modifies the weight of an existing element.
+         * @return Returns the last weight of the element before modification or `nullopt` if the element is not found.
+         */
+        optional<uint> modify(const E& element, uint weight){
+            return modify<E>(element, weight);
+        }
+
+        /**
+         * @brief Modifies the weight of the existing element equal to the key.
+         * @return Returns the last weight of the element before modification or `nullopt` if the element is not found.
+         */
+        template<typename K, EnableIfKey<K> = 0>
+        optional<uint> modify(const K& key, uint weight){
+            uint slot = findSlot(key);
+            if(slot != detail::npos){
+                uint prev_weight = _weights[slot];
+                setWeight(slot, weight);
+                return prev_weight;
+            }
+            return nullopt;
+        }
+
+        /**
+         * @brief Modifies the weight of the element of a valid handle without looking it up.
+         * @return Returns the last weight of the element before modification.
+         */
+        uint modify(Handle handle, uint weight){
+            uint prev_weight = _weights[handle.index()];
+            setWeight(handle.index(), weight);
+            return prev_weight;
+        }
+
+        /**
+         * @brief Applies a batch of changes at once, each element at most once. The whole batch is checked before
+         * anything is changed, so if an erased element is not found, an element appears twice, or the total weight
+         * would not fit in `uint`, nothing is applied. All the elements are looked up in one pass over the index, the
+         * new ones are merged into it in one more and the erased ones removed by slot in another, the weights of the
+         * existing ones are written in slot order, and the engine is rebuilt once on the next draw.
+         * @return `true` - every change is applied, `false` - the generator is left as it was.
+         */
+        template<typename ForwardIt, typename = typename iterator_traits<ForwardIt>::iterator_category>
+        bool apply(ForwardIt first, ForwardIt last){
+            vector<const Delta*> deltas;
+            vector<const E*> keys;
+            for(; first != last; ++first){
+                deltas.push_back(&*first);
+                keys.push_back(&first->element);
+            }
+
+            // Find the slot of every delta, or `npos` for a new element, without changing anything yet.
+            vector<uint> slots = _index.findMany(_elements, keys);
+            vector<pair<uint, uint>> existing;
+            uint64_t total = _total_weight;
+            size_t inserted = 0;
+            for(size_t i = 0; i < deltas.size(); i++){
+                const Delta &delta = *deltas[i];
+                if(slots[i] == detail::npos){
+                    if(delta.erase)
+                        return false;
+                    total += delta.weight;
+                    ++inserted;
+                }
+                else{
+                    existing.push_back({slots[i], (uint) i});
+                    total = total - _weights[slots[i]] + (delta.erase ? 0 : delta.weight);
+                }
+            }
+            detail::radixSort(existing);
+            auto same_slot = [](const pair<uint, uint> &a, const pair<uint, uint> &b){
+                return a.first == b.first;
+            };
+            if(adjacent_find(existing.begin(), existing.end(), same_slot) != existing.end() || total > UINT_MAX)
+                return false;
+
+            // Give the new elements free slots first, then append the rest in order.
+            size_t reused = min(inserted, _free_slots.size());
+            size_t old_size = _elements.size();
+            vector<uint> fresh;
+            vector<const Delta*> added;
+            fresh.reserve(inserted);
+            added.reserve(inserted);
+            for(size_t i = 0; i < deltas.size(); i++){
+                if(slots[i] != detail::npos)
+                    continue;
+                added.push_back(deltas[i]);
+                if(fresh.size() < reused){
+                    slots[i] = _free_slots[_free_slots.size() - 1 - fresh.size()];
+                    _elements[slots[i]] = deltas[i]->element;
+                }
+                else{
+                    slots[i] = _elements.size();
+                    _elements.push_back(deltas[i]->element);
+                    _weights.push_back(0);
+                }
+                fresh.push_back(slots[i]);
+            }
+            if(!_index.insertMany(_elements, fresh)){
+                // Two new elements are equal: give the slots back.
+                _elements.erase(_elements.begin() + old_size, _elements.end());
+                _weights.resize(old_size);
+                if constexpr(is_default_constructible_v<E>)
+                    for(size_t k = 0; k < reused; k++)
+                        _elements[fresh[k]] = E();
+                return false;
+            }
+            _free_slots.resize(_free_slots.size() - reused);
+
+            vector<uint> erased;
+            for(const pair<uint, uint> &e : existing)
+                if(deltas[e.second]->erase)
+                    erased.push_back(e.first);
+            _index.eraseMany(_elements, erased);
+            for(const pair<uint, uint> &e : existing){
+                if(deltas[e.second]->erase)
+                    releaseSlot(e.first);
+                else
+                    setWeight(e.first, deltas[e.second]->weight);
+            }
+            for(size_t k = 0; k < fresh.size(); k++)
+                setWeight(fresh[k], added[k]->weight);
+            return true;
+        }
+
+        /**
+         * @brief Applies a batch of changes at once. See `apply(first, last)`.
+         */
+        bool apply(const vector<Delta> &deltas){
+            return apply(deltas.begin(), deltas.end());
+        }
+
+        /**
+         * @brief Returns `std::vector` of elements as a sample.
+         */
+        vector<E> sample(size_t amount){
+            return sample(amount, _rng);
+        }
+
+        /**
+         * @brief Returns `std::vector` of elements as a sample drawn with the given randomizer.
+         */
+        template<typename R>
+        vector<E> sample(size_t amount, R &rng) const {
+            vector<E> ret;
+            if(_total_weight != 0){
+                ret.reserve(amount);
+                drawMany(rng, amount, back_inserter(ret), [this](uint slot) -> const E& { return _elements[slot]; });
+            }
+            return ret;
+        }
+
+        /**
+         * @brief Returns `amount` random elements drawn on `threads` threads, or on one per core if it is 0. The draws
+         * are split into chunks of `parallel_chunk`, and chunk c has its own stream derived from the last seed given
+         * to the constructor or `seed()`: jumped ahead c times with `jump()` if `URBG` has one, or seeded from a hash
+         * of the seed and c otherwise. So the result depends on the seed only, never on `threads`, and the randomizer
+         * of the generator is left untouched. `E` must be default constructible.
+         */
+        vector<E> parallelSample(size_t amount, unsigned threads) const {
+            if(_total_weight == 0)
+                return {};
+            // Build on this thread, so that a failed allocation throws here instead of in a worker.
+            if(!_frozen)
+                build();
+
+            size_t chunks = (amount + parallel_chunk - 1) / parallel_chunk;
+            vector<URBG> streams(chunks);
+            if constexpr(detail::HasJump<URBG>::value){
+                URBG rng;
+                rng.seed(_seed);
+                for(URBG &stream : streams){
+                    stream = rng;
+                    rng.jump();
+                }
+            }
+            else{
+                for(size_t c = 0; c < chunks; c++){
+                    SplitMix64 mixer(_seed ^ (c * 0x9e3779b97f4a7c15));
+                    streams[c].seed(mixer());
+                }
+            }
+
+            vector<E> ret(amount);
+            detail::parallelFor(chunks, threads, [&](size_t c){
+                size_t first = c * parallel_chunk;
+                drawMany(streams[c], min(parallel_chunk, amount - first), ret.begin() + first,
+                    [this](uint slot) -> const E& { return _elements[slot]; });
+            });
+            return ret;
+        }
+
+        /**
+         * @brief Returns draw number `index` of stream `stream`, or `nullopt` if it is empty. The draw is a pure
+         * function of the last seed, `stream`, `index` and the weights: it uses a `Philox4x32` keyed by the seed whose
+         * counter is (index, stream, block), so every draw has blocks of its own. Any worker can compute any slice of
+         * the sequence in any order, and the randomizer of the generator is left untouched.
+         */
+        optional<E> sampleAt(uint64_t index, uint32_t stream = 0) const {
+            uint slot = drawSlotAt(index, stream);
+            if(slot == detail::npos)
+                return nullopt;
+            return _elements[slot];
+        }
+
+        /**
+         * @brief Writes draws `first` to `first + amount - 1` of stream `stream` to `out`, the same elements that
+         * `sampleAt()` returns for them. Writes nothing if it is empty.
+         * @return The output iterator past the last element written.
+         */
+        template<typename OutputIt>
+        OutputIt sampleAt(uint64_t first, size_t amount, OutputIt out, uint32_t stream = 0) const {
+            if(_total_weight == 0)
+                return out;
+            for(uint64_t index = first; index < first + amount; ++index, ++out)
+                *out = _elements[drawSlotAt(index, stream)];
+            return out;
+        }
+
+        /**
+         * @brief Writes `amount` random elements to `out`, each an independent draw. Writes nothing if it is empty.
+         * @return The output iterator past the last element written.
+         */
+        template<typename OutputIt>
+        OutputIt sampleTo(OutputIt out, size_t amount){
+            return sampleTo(out, amount, _rng);
+        }
+
+        /**
+         * @brief Writes `amount` random elements drawn with the given randomizer to `out`.
+         * @return The output iterator past the last element written.
+         */
+        template<typename OutputIt, typename R>
+        OutputIt sampleTo(OutputIt out, size_t amount, R &rng) const {
+            return drawMany(rng, amount, out, [this](uint slot) -> const E& { return _elements[slot]; });
+        }
+
+        /**
+         * @brief Fills `[first, last)` with random elements without allocating. Leaves it untouched if it is empty.
+         * @return `last`, or `first` if it is empty.
+         */
+        template<typename ForwardIt>
+        ForwardIt sampleInto(ForwardIt first, ForwardIt last){
+            return sampleInto(first, last, _rng);
+        }
+
+        /**
+         * @brief Fills `[first, last)` with random elements drawn with the given randomizer.
+         * @return `last`, or `first` if it is empty.
+         */
+        template<typename ForwardIt, typename R>
+        ForwardIt sampleInto(ForwardIt first, ForwardIt last, R &rng) const {
+            return sampleTo(first, distance(first, last), rng);
+        }
+
+        /**
+         * @brief Fills `[first, last)` with the slots of random elements, usable with `Handle`. Leaves it untouched if
+         * it is empty.
+         * @return `last`, or `first` if it is empty.
+         */
+        template<typename ForwardIt>
+        ForwardIt sampleIndices(ForwardIt first, ForwardIt last){
+            return sampleIndices(first, last, _rng);
+        }
+
+        /**
+         * @brief Fills `[first, last)` with the slots of random elements drawn with the given randomizer.
+         * @return `last`, or `first` if it is empty.
+         */
+        template<typename ForwardIt, typename R>
+        ForwardIt sampleIndices(ForwardIt first, ForwardIt last, R &rng) const {
+            return drawMany(rng, distance(first, last), first, [](uint slot){ return slot; });
+        }
+
+        /**
+         * @brief Returns `amount` random elements sorted by slot, or shuffled if `shuffled` is `true`.
+         * Instead of searching once per draw, it generates `amount` sorted uniforms from exponential spacings and
+         * merges them with one pass over the weights, O(n + amount) with purely sequential memory access. It reads
+         * the weights directly, so it does not need `update()`.
+         */
+        vector<E> sampleSorted(size_t amount, bool shuffled = false){
+            return sampleSorted(amount, shuffled, _rng);
+        }
+
+        /**
+         * @brief Same as above, drawn with the given randomizer.
+         */
+        template<typename R>
+        vector<E> sampleSorted(size_t amount, bool shuffled, R &rng) const {
+            vector<E> ret;
+            if(_total_weight == 0 || amount == 0)
+                return ret;
+
+            // The partial sums of amount + 1 exponentials, divided by the last one, are amount sorted uniforms.
+            vector<double> targets(amount);
+            double sum = 0;
+            for(double &target : targets){
+                sum -= log(detail::uniform01(rng));
+                target = sum;
+            }
+            sum -= log(detail::uniform01(rng));
+            double scale = _total_weight / sum;
+
+            ret.reserve(amount);
+            size_t slot = 0;
+            double cumulative = _weights[0];
+            for(double target : targets){
+                target *= scale;
+                while(cumulative <= target && slot + 1 < _weights.size())
+                    cumulative += _weights[++slot];
+                // Rounding can push the last targets onto the total; keep them on a slot with a weight.
+                while(_weights[slot] == 0)
+                    --slot;
+                ret.push_back(_elements[slot]);
+            }
+
+            if(shuffled){
+                for(size_t i = ret.size() - 1; i > 0; --i)
+                    swap(ret[i], ret[detail::bounded(rng, i + 1)]);
+            }
+            return ret;
+        }
+
+        /**
+         * @brief Returns how many times each element would be picked in `amount` draws, as the elements with a non-zero
+         * count and their counts, sorted by slot. Walks the elements once and splits the remaining draws with one
+         * binomial variate per element, so it costs O(n) no matter how large `amount` is. It reads the weights
+         * directly, so it does not need `update()`.
+         */
+        vector<pair<E, uint64_t>> sampleCounts(uint64_t amount){
+            return sampleCounts(amount, _rng);
+        }
+
+        /**
+         * @brief Same as above, drawn with the given randomizer.
+         */
+        template<typename R>
+        vector<pair<E, uint64_t>> sampleCounts(uint64_t amount, R &rng) const {
+            vector<pair<E, uint64_t>> ret;
+            uint64_t remaining_weight = _total_weight;
+            for(size_t slot = 0; slot < _weights.size() && amount > 0; ++slot){
+                uint weight = _weights[slot];
+                if(weight == 0)
+                    continue;
+                // Given the draws left, the ones landing here follow Binomial(amount, weight / remaining weight).
+                uint64_t count = weight == remaining_weight
+                    ? amount : detail::binomial(rng, amount, (double) weight / remaining_weight);
+                if(count != 0)
+                    ret.emplace_back(_elements[slot], count);
+                amount -= count;
+                remaining_weight -= weight;
+            }
+            return ret;
+        }
+
+        /**
+         * @brief Returns `amount` distinct random elements drawn without replacement, sorted by slot. Elements whose
+         * weight is zero are never picked, so it returns fewer if there are not enough of the others.
+         * Uses the exponential keys of Efraimidis and Spirakis: the `amount` smallest `Exp(1) / weight` win. The
+         * largest winning key is selected with `std::nth_element`, and one pass in slot order collects the keys up to
+         * it, so it costs O(n) for any `amount`. The weights are left untouched and `update()` is not needed.
+         */
+        vector<E> sampleDistinct(size_t amount){
+            return sampleDistinct(amount, _rng);
+        }
+
+        /**
+         * @brief Same as above, drawn with the given randomizer.
+         */
+        template<typename R>
+        vector<E> sampleDistinct(size_t amount, R &rng) const {
+            size_t candidates = _weights.size() - count(_weights.begin(), _weights.end(), 0u);
+            vector<E> ret;
+            if(amount >= candidates){
+                for(size_t slot = 0; slot < _weights.size(); ++slot){
+                    if(_weights[slot] != 0)
+                        ret.push_back(_elements[slot]);
+                }
+                return ret;
+            }
+
+            if(amount == 0)
+                return ret;
+
+            // Winners have the smallest keys; ties with the largest winning key, if any, go to the lower slots.
+            vector<double> keys(_weights.size());
+            vector<double> selection;
+            selection.reserve(candidates);
+            for(size_t slot = 0; slot < _weights.size(); ++slot){
+                if(_weights[slot] == 0)
+                    continue;
+                keys[slot] = -log(detail::uniform01(rng)) / _weights[slot];
+                selection.push_back(keys[slot]);
+            }
+            nth_element(selection.begin(), selection.begin() + (amount - 1), selection.end());
+            double largest = selection[amount - 1];
+            auto below = [largest](double key){
+                return key < largest;
+            };
+            size_t ties = amount - count_if(selection.begin(), selection.begin() + (amount - 1), below);
+
+            ret.reserve(amount);
+            for(size_t slot = 0; slot < _weights.size(); ++slot){
+                if(_weights[slot] == 0 || keys[slot] > largest)
+                    continue;
+                if(keys[slot] == largest){
+                    if(ties == 0)
+                        continue;
+                    --ties;
+                }
+                ret.push_back(_elements[slot]);
+            }
+            return ret;
+        }
+
+#if defined(__cpp_lib_span)
+        /**
+         * @brief Fills the span with random elements without allocating.
+         */
+        void sampleInto(span<E> out){
+            sampleInto(out.begin(), out.end());
+        }
+
+        template<typename R>
+        void sampleInto(span<E> out, R &rng) const {
+            sampleInto(out.begin(), out.end(), rng);
+        }
+
+        /**
+         * @brief Fills the span with the slots of random elements.
+         */
+        void sampleIndices(span<uint> out){
+            sampleIndices(out.begin(), out.end());
+        }
+
+        template<typename R>
+        void sampleIndices(span<uint> out, R &rng) const {
+            sampleIndices(out.begin(), out.end(), rng);
+        }
+
+        /**
+         * @brief Applies a batch of changes at once. See `apply(first, last)`.
+         */
+        bool apply(span<const Delta> deltas){
+            return apply(deltas.begin(), deltas.end());
+        }
+#endif
+
+        /**
+         * @brief Returns a random element or `nullopt` if it is empty.
+         */
+        optional<E> operator()(){
+            return (*this)(_rng);
+        }
+
+        /**
+         * @brief Returns a random element drawn with the given randomizer or `nullopt` if it is empty.
+         */
+        template<typename R>
+        optional<E> operator()(R &rng) const {
+            uint slot = drawSlot(rng);
+            if(slot == detail::npos)
+                return nullopt;
+            return _elements[slot];
+        }
+
+        /**
+         * @brief Returns a pointer to a random element or `nullptr` if it is empty. Never copies or allocates, unless
+         * it is the first draw after a change and the engine has to be rebuilt, so it is only `noexcept` for
+         * incremental engines. The pointer stays valid until the next modifier.
+         */
+        const E* drawRef() noexcept(!lazy) {
+            return drawRef(_rng);
+        }
+
+        /**
+         * @brief Returns a pointer to a random element drawn with the given randomizer or `nullptr` if it is empty.
+         */
+        template<typename R>
+        const E* drawRef(R &rng) const noexcept(!lazy) {
+            uint slot = drawSlot(rng);
+            return slot == detail::npos ? nullptr : &_elements[slot];
+        }
+
+        /**
+         * @brief Returns the slot of a random element, usable with `Handle`, or `npos` if it is empty.
+         */
+        uint drawIndex() noexcept(!lazy) {
+            return drawSlot(_rng);
+        }
+
+        /**
+         * @brief Returns the slot of a random element drawn with the given randomizer or `npos` if it is empty.
+         */
+        template<typename R>
+        uint drawIndex(R &rng) const noexcept(!lazy) {
+            return drawSlot(rng);
+        }
+    };
+
     /**
      * @author dzunni
-     * @version 1.0
      * @brief
-     * The `dzunni::RandomWeightedObjectGenerator` class is a container and a random object generator class that contains
-     * unique elements of type `E` and each element has a weight. `E` must have the requirements for `std::set`. The weight
-     * is an unsigned integer that determines each element's probability which equals to the element's weight divided by the
-     * total weight of all elements.
-     * 
-     * The class uses `mt19937` engine from C++ standard library for randomness.
-     * 
-     * The class needs a seed for the randomizer through its constructor. You can set a new seed by calling `seed()`.
-     * 
-     * The class offers modifiers: `insert()`, `erase()`, `modify()`, and `clear()`, which modifies the elements and
-     * their weight. Make sure that after using any of them, call `update()` to update the randomizer.
-     * 
-     * You can determine the container's information about itself:
-     * 
-     * `empty()` - if it is empty;
-     * 
-     * `size()` - the number of elements contained;
-     * 
-     * `totalWeight()` - the total weight of all elements;
-     * 
-     * `contains()` - if it contains a specified element;
-     * 
-     * Or about its elements:
-     * 
-     * `weight()` - the weight of the specified element;
+     * The `dzunni::ConcurrentRandomWeightedObjectGenerator` class lets one or more writers change a distribution while
+     * many reader threads draw from it without locks. Writers use the usual modifiers, which go to a private
+     * `RandomWeightedObjectGenerator`, and call `publish()` to make a read-only copy of it with its engine built. The
+     * copy is published through an atomic pointer, so readers keep drawing from the previous one while it is built.
      * 
-     * `probability()` - the probability of the specified element.
+     * Every reader thread gets its own `Reader` from `reader()`. A draw loads the published pointer, draws, and then
+     * records the version it has finished with in the reader's own cache line: one acquire load and one release store,
+     * with no lock and no read-modify-write. A retired copy is freed by a later `publish()` once every reader has
+     * finished with a newer one. A `Reader` that stops drawing keeps the copies it may still see alive, so destroy
+     * it when its thread is done.
      * 
-     * Finally, call its operator `operator()` to generate a random element. Additionally, you can call `sample()`
-     * to get a set amount of random elements.
+     * `publish()` copies the elements and rebuilds the engine, so it is meant to follow a batch of changes rather than
+     * every single one. Writers are serialized by a mutex that readers never take.
      * 
-     * Note: Elements whose weight is zero can be contained but will never be picked by the randomizer.
+     * Note: Every `Reader` must be destroyed before the generator.
      */
-    template<typename E>
-    class RandomWeightedObjectGenerator{
+    template<typename E, typename Sampler = CdfSampler, typename URBG = Xoshiro256PlusPlus,
+        typename Index = OrderedIndex>
+    class ConcurrentRandomWeightedObjectGenerator{
+    public:
+        using Generator = RandomWeightedObjectGenerator<E, Sampler, URBG, Index>;
+
     private:
-        using uint = unsigned int;
+        static constexpr uint64_t offline = UINT64_MAX;
 
-        mt19937 _rng;
-        uniform_int_distribution<uint> _dis;
-        uint _total_weight = 0;
+        struct Snapshot {
+            uint64_t version;
+            Generator generator;
 
-        uint getTotalWeight(){
-            return _total_weight;
+            Snapshot(uint64_t version, const Generator &generator) : version(version), generator(generator) {
+                this->generator.update();
+            }
+        };
+
+        // The version of the newest snapshot a reader has finished a draw with, or `offline`. One per cache line.
+        struct alignas(64) ReaderSlot {
+            atomic<uint64_t> seen{offline};
+            bool active = false;
+        };
+
+        mutable mutex _mutex;
+        Generator _writer;
+        atomic<const Snapshot*> _current{nullptr};
+        vector<unique_ptr<const Snapshot>> _retired;
+        vector<unique_ptr<ReaderSlot>> _readers;
+
+        // Frees the retired snapshots that no reader can still be using. Called with `_mutex` held.
+        void reclaim(){
+            uint64_t oldest = offline;
+            for(const auto &slot : _readers)
+                oldest = min(oldest, slot->seen.load(memory_order_acquire));
+            // A reader that has finished a draw with version v never loads an older one again.
+            _retired.erase(remove_if(_retired.begin(), _retired.end(), [oldest](const auto &snapshot){
+                return snapshot->version < oldest;
+            }), _retired.end());
         }
 
-        struct Data {
-            uint lower_boundary;
-            uint upper_boundary;
-            E element;
+    public:
+        /**
+         * @brief Draws from the published snapshot on behalf of one thread. Not thread-safe itself: every thread needs
+         * its own.
+         */
+        class Reader {
+        private:
+            const ConcurrentRandomWeightedObjectGenerator *_owner;
+            ReaderSlot *_slot;
+            URBG _rng;
+
+            friend class ConcurrentRandomWeightedObjectGenerator;
 
-            Data(const E& e, uint lower_boundary = 0, uint upper_boundary = 0)
-            : element(e), lower_boundary(lower_boundary), upper_boundary(upper_boundary)
-            {}
+            Reader(const ConcurrentRandomWeightedObjectGenerator *owner, ReaderSlot *slot, uint64_t seed)
+                : _owner(owner), _slot(slot) {
+                _rng.seed(seed);
+            }
+
+        public:
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+
+            Reader(Reader &&other) : _owner(other._owner), _slot(other._slot), _rng(move(other._rng)) {
+                other._slot = nullptr;
+            }
+
+            ~Reader(){
+                if(_slot == nullptr)
+                    return;
+                lock_guard<mutex> lock(_owner->_mutex);
+                _slot->seen.store(offline, memory_order_relaxed);
+                _slot->active = false;
+            }
+
+            /**
+             * @brief Calls `f` with the published generator and returns what it returns. The generator may be freed
+             * afterwards, so `f` must not return references into it.
+             */
+            template<typename F>
+            auto read(F f){
+                const Snapshot *snapshot = _owner->_current.load(memory_order_acquire);
+                auto result = f(snapshot->generator);
+                _slot->seen.store(snapshot->version, memory_order_release);
+                return result;
+            }
 
-            bool operator<(const Data &other_data) const {
-                return element < other_data.element;
+            /**
+             * @brief The seed for the randomizer of this reader.
+             */
+            void seed(uint64_t seed){
+                _rng.seed(seed);
             }
 
-            uint weight() const {
-                return upper_boundary - lower_boundary + 1;
+            /**
+             * @brief Returns a random element or `nullopt` if it is empty.
+             */
+            optional<E> operator()(){
+                return (*this)(_rng);
+            }
+
+            /**
+             * @brief Returns a random element drawn with the given randomizer or `nullopt` if it is empty.
+             */
+            template<typename R>
+            optional<E> operator()(R &rng){
+                return read([&rng](const Generator &generator){
+                    return generator(rng);
+                });
+            }
+
+            /**
+             * @brief Returns `std::vector` of elements as a sample, all from the same snapshot.
+             */
+            vector<E> sample(size_t amount){
+                return sample(amount, _rng);
+            }
+
+            template<typename R>
+            vector<E> sample(size_t amount, R &rng){
+                return read([amount, &rng](const Generator &generator){
+                    return generator.sample(amount, rng);
+                });
             }
         };
 
-        set<Data> _data_set;
+        ConcurrentRandomWeightedObjectGenerator() : _writer(0) {
+            _current.store(new Snapshot(0, _writer), memory_order_release);
+        }
 
-    public:
-        RandomWeightedObjectGenerator(uint seed){
-            _rng.seed(seed);
+        ConcurrentRandomWeightedObjectGenerator(const ConcurrentRandomWeightedObjectGenerator&) = delete;
+        ConcurrentRandomWeightedObjectGenerator& operator=(const ConcurrentRandomWeightedObjectGenerator&) = delete;
+
+        ~ConcurrentRandomWeightedObjectGenerator(){
+            delete _current.load(memory_order_relaxed);
         }
 
         /**
-         * @brief Only copies its elements and their weights, and total weight.
-         * Call `seed()` and `update()` it after copying.
+         * @brief Registers a reader whose own randomizer starts from `seed`.
          */
-        RandomWeightedObjectGenerator(const RandomWeightedObjectGenerator &other){
-            _data_set = other._data_set;
-            _total_weight = other._total_weight;
+        Reader reader(uint64_t seed){
+            lock_guard<mutex> lock(_mutex);
+            auto it = find_if(_readers.begin(), _readers.end(), [](const auto &slot){
+                return !slot->active;
+            });
+            if(it == _readers.end()){
+                _readers.push_back(make_unique<ReaderSlot>());
+                it = _readers.end() - 1;
+            }
+            (*it)->active = true;
+            (*it)->seen.store(_current.load(memory_order_relaxed)->version, memory_order_relaxed);
+            return Reader(this, it->get(), seed);
         }
 
-        RandomWeightedObjectGenerator(RandomWeightedObjectGenerator &&other){
-            _data_set = move(other._data_set);
-            _total_weight = other._total_weight;
-            _rng = move(other._rng);
-            _dis = move(other._dis);
+        /**
+         * @brief Publishes a copy of the elements written so far and frees the old copies no reader can still see.
+         * Readers switch to it on their next draw.
+         */
+        void publish(){
+            lock_guard<mutex> lock(_mutex);
+            const Snapshot *prev = _current.load(memory_order_relaxed);
+            _current.store(new Snapshot(prev->version + 1, _writer), memory_order_release);
+            _retired.emplace_back(prev);
+            reclaim();
         }
 
         /**
-         * @brief The seed for the randomizer.
+         * @brief Returns the version of the published snapshot, counted by `publish()`.
          */
-        void seed(uint seed){
-            _rng.seed(seed);
+        uint64_t version() const {
+            return _current.load(memory_order_acquire)->version;
         }
 
         /**
-         * @brief Updates the randomizer. Call this after using `insert()`, `erase()`, `clear()`, and `modify()`.
+         * @brief Inserts an element with its weight. Readers see it after the next `publish()`.
+         * @return `true` - successfully added, `false` - there is already an identical element.
          */
-        void update(){
-            if(_total_weight != 0)
-                _dis = uniform_int_distribution<uint>(1, _total_weight);
+        bool insert(const E &element, uint weight){
+            lock_guard<mutex> lock(_mutex);
+            return _writer.insert(element, weight);
         }
 
         /**
-         * Returns the number of elements.
+         * @brief Erases an element. Readers see it after the next `publish()`.
+         * @return Returns the weight of the element or `nullopt` if the element is not found.
          */
-        size_t size(){
-            return _data_set.size();
+        optional<uint> erase(const E &element){
+            lock_guard<mutex> lock(_mutex);
+            return _writer.erase(element);
         }
 
         /**
-         * @brief Determines if it is empty.
+         * @brief Modifies the weight of an existing element. Readers see it after the next `publish()`.
+         * @return Returns the last weight of the element before modification or `nullopt` if the element is not found.
          */
-        bool empty(){
-            return _data_set.empty();
+        optional<uint> modify(const E &element, uint weight){
+            lock_guard<mutex> lock(_mutex);
+            return _writer.modify(element, weight);
         }
 
         /**
-         * @brief Returns the total weight of all elements.
+         * @brief Applies a batch of changes at once, as `RandomWeightedObjectGenerator::apply()` does. Readers see
+         * it after the next `publish()`.
          */
-        uint totalWeight(){
-            return _total_weight;
+        bool apply(const vector<typename Generator::Delta> &deltas){
+            lock_guard<mutex> lock(_mutex);
+            return _writer.apply(deltas);
         }
 
         /**
-         * @brief Determines if the element exists.
+         * @brief Clears the elements. Readers see it after the next `publish()`.
+         */
+        void clear(){
+            lock_guard<mutex> lock(_mutex);
+            _writer.clear();
+        }
+    };
+
+    /**
+     * @author dzunni
+     * @brief
+     * The `dzunni::ShardedRandomWeightedObjectGenerator` class spreads its elements over independent shards by the
+     * hash of the element, so threads that change different elements rarely touch the same shard. Every shard is a
+     * `RandomWeightedObjectGenerator` with its own mutex on its own cache line, and publishes its total weight in an
+     * atomic after every change. `FenwickSampler` is the default engine, so a change costs O(log n) under the lock of
+     * one shard and never leaves a rebuild behind.
+     * 
+     * A draw reads the shard totals without locking, picks a shard in proportion to them, and then draws from that
+     * shard under its lock. Without concurrent writers the elements come out with exactly their probability; while
+     * writers run, the choice of shard reflects the totals at the moment they were read.
+     * 
+     * `E` must be hashable with `std::hash`, and meet the requirements of the `Index` of the shards.
+     */
+    template<typename E, typename Sampler = FenwickSampler, typename URBG = Xoshiro256PlusPlus,
+        typename Index = OrderedIndex>
+    class ShardedRandomWeightedObjectGenerator{
+    public:
+        using Generator = RandomWeightedObjectGenerator<E, Sampler, URBG, Index>;
+
+    private:
+        struct alignas(64) Shard {
+            mutable mutex lock;
+            Generator generator{0};
+            atomic<uint> total{0};
+            atomic<size_t> size{0};
+        };
+
+        unique_ptr<Shard[]> _shards;
+        size_t _shard_count;
+
+        Shard& shardOf(const E &element) const {
+            uint64_t mixed = (uint64_t) hash<E>{}(element) * 0x9e3779b97f4a7c15;
+            return _shards[((mixed >> 32) * _shard_count) >> 32];
+        }
+
+        // Writes back the totals of a shard whose lock is held. Only its writer stores them, so a plain store will do.
+        static void publish(Shard &shard){
+            shard.total.store(shard.generator.totalWeight(), memory_order_relaxed);
+            shard.size.store(shard.generator.size(), memory_order_relaxed);
+        }
+
+    public:
+        /**
+         * @brief Creates `shards` empty shards, e.g. `thread::hardware_concurrency()` of them.
          */
-        bool contains(const E& element){
-            return _data_set.find(element) != _data_set.end();
+        explicit ShardedRandomWeightedObjectGenerator(size_t shards)
+            : _shards(new Shard[max<size_t>(shards, 1)]), _shard_count(max<size_t>(shards, 1)) {}
+
+        /**
+         * @brief Returns the number of shards.
+         */
+        size_t shards() const {
+            return _shard_count;
         }
 
         /**
-         * @brief Returns the weight of the element or `nullopt` if the element is not found.
+         * Returns the number of elements.
          */
-        optional<uint> weight(const E& element){
-            auto it = _data_set.find(element);
-            if(it == _data_set.end())
-                return nullopt;
-            return it->weight();
+        size_t size() const {
+            size_t size = 0;
+            for(size_t i = 0; i < _shard_count; i++)
+                size += _shards[i].size.load(memory_order_relaxed);
+            return size;
         }
 
         /**
-         * @brief Returns the probability of the element or `nullopt` if the element is not found.
+         * @brief Determines if it is empty.
          */
-        optional<double> probability(const E& element){
-            auto it = _data_set.find(element);
-            if(it == _data_set.end())
-                return nullopt;
-            return (double) it->weight() / _total_weight;
+        bool empty() const {
+            return size() == 0;
         }
 
         /**
-         * @brief Inserts an element with its weight.
+         * @brief Returns the total weight of all elements, which may exceed `uint`.
+         */
+        uint64_t totalWeight() const {
+            uint64_t total = 0;
+            for(size_t i = 0; i < _shard_count; i++)
+                total += _shards[i].total.load(memory_order_relaxed);
+            return total;
+        }
+
+        /**
+         * @brief Determines if it contains the element.
+         */
+        bool contains(const E &element) const {
+            Shard &shard = shardOf(element);
+            lock_guard<mutex> lock(shard.lock);
+            return shard.generator.contains(element);
+        }
+
+        /**
+         * @brief Returns the weight of the element or `nullopt` if it is not found.
+         */
+        optional<uint> weight(const E &element) const {
+            Shard &shard = shardOf(element);
+            lock_guard<mutex> lock(shard.lock);
+            return shard.generator.weight(element);
+        }
+
+        /**
+         * @brief Inserts an element with its weight, locking only its shard.
          * @return `true` - successfully added, `false` - there is already an identical element.
          */
         bool insert(const E &element, uint weight){
-            if(contains(element))
-                return false;
-            
-            uint lower_boundary = _total_weight + 1;
-            uint upper_boundary = _total_weight + weight;
-            _total_weight = upper_boundary;
-
-            // cout << "L=" << lower_boundary << ", U=" << upper_boundary << endl;
-            _data_set.insert(Data(element, lower_boundary, upper_boundary));
-            return true;
+            Shard &shard = shardOf(element);
+            lock_guard<mutex> lock(shard.lock);
+            bool inserted = shard.generator.insert(element, weight);
+            publish(shard);
+            return inserted;
         }
 
         /**
-         * @brief Erases an element along with their weight.
+         * @brief Erases an element, locking only its shard.
          * @return Returns the weight of the element or `nullopt` if the element is not found.
          */
         optional<uint> erase(const E &element){
-            auto it = _data_set.find(element);
-            if(it != _data_set.end()){
-                uint weight = it->weight();
-                _total_weight -= weight;
-                _data_set.erase(it);
-                return weight;
-            }
-            return nullopt;
+            Shard &shard = shardOf(element);
+            lock_guard<mutex> lock(shard.lock);
+            optional<uint> weight = shard.generator.erase(element);
+            publish(shard);
+            return weight;
         }
 
         /**
-         * @brief Clears the set and the total weight.
+         * @brief Modifies the weight of an existing element, locking only its shard.
+         * @return Returns the last weight of the element before modification or `nullopt` if the element is not found.
+         */
+        optional<uint> modify(const E &element, uint weight){
+            Shard &shard = shardOf(element);
+            lock_guard<mutex> lock(shard.lock);
+            optional<uint> prev_weight = shard.generator.modify(element, weight);
+            publish(shard);
+            return prev_weight;
+        }
+
+        /**
+         * @brief Clears every shard, one at a time.
          */
         void clear(){
-            _data_set.clear();
-            _total_weight = 0;
+            for(size_t i = 0; i < _shard_count; i++){
+                lock_guard<mutex> lock(_shards[i].lock);
+                _shards[i].generator.clear();
+                publish(_shards[i]);
+            }
         }
 
         /**
-         * @brief Modifies the weight of an existing element.
-         * @return Returns the last weight of the element before modification or `nullopt` if the element is not found.
+         * @brief Returns a random element drawn with the given randomizer or `nullopt` if it is empty. Every thread
+         * needs its own randomizer.
          */
-        optional<uint> modify(const E& element, uint weight){
-            auto it = _data_set.find(element);
-            if(it != _data_set.end()){
-                uint prev_weight = it->weight();
-                _total_weight = _total_weight - prev_weight + weight;
-                return prev_weight;
+        template<typename R>
+        optional<E> operator()(R &rng) const {
+            while(true){
+                uint64_t total = totalWeight();
+                if(total == 0)
+                    return nullopt;
+                // A uniform number below `total` by rejection from the smallest power of two above it.
+                unsigned shift = detail::countLeadingZeros(total);
+                uint64_t target;
+                do
+                    target = detail::random64(rng) >> shift;
+                while(target >= total);
+
+                size_t i = 0;
+                for(; i + 1 < _shard_count; i++){
+                    uint shard_total = _shards[i].total.load(memory_order_relaxed);
+                    if(target < shard_total)
+                        break;
+                    target -= shard_total;
+                }
+                lock_guard<mutex> lock(_shards[i].lock);
+                // The shard may have been emptied since its total was read; then start over.
+                if(optional<E> element = _shards[i].generator(rng))
+                    return element;
             }
-            return nullopt;
         }
 
         /**
-         * @brief Returns `std::vector` of elements as a sample.
+         * @brief Returns `std::vector` of elements as a sample drawn with the given randomizer.
          */
-        vector<E> sample(size_t amount){
+        template<typename R>
+        vector<E> sample(size_t amount, R &rng) const {
             vector<E> ret;
-            if(_total_weight != 0){
-                E e = *(this->operator()());
-                while(amount > 0){
-                    ret.push_back(e);
-                    --amount;
-                }
+            ret.reserve(amount);
+            for(size_t i = 0; i < amount; i++){
+                optional<E> element = (*this)(rng);
+                if(!element)
+                    break;
+                ret.push_back(*element);
             }
             return ret;
         }
+    };
+
+    /**
+     * @author dzunni
+     * @brief
+     * The `dzunni::WeightedReservoir` class keeps a weighted sample without replacement of up to `capacity` elements
+     * from a stream that is too large to insert into a `RandomWeightedObjectGenerator`. Feed it (element, weight)
+     * pairs with `push()`, one at a time or from an input iterator range, and read the sample with `sample()`.
+     * 
+     * It is Efraimidis and Spirakis' A-ExpJ: every kept element has the key `u^(1 / weight)` and the smallest kept key
+     * is the threshold. Instead of drawing a key for every element, it draws how much weight to skip until the next
+     * element that beats the threshold, so it keeps O(capacity) memory and consumes O(capacity log(n / capacity))
+     * random numbers. Keys are stored as logarithms to avoid underflow. They come from the C library's `log()` and
+     * `exp()`, so a seed replays the same sample only on the same platform and standard library.
+     * 
+     * Reservoirs filled from different parts of a stream, e.g. by different threads with different seeds, can be
+     * combined with `merge()`.
+     * 
+     * Note: Elements whose weight is zero are skipped.
+     */
+    template<typename E, typename URBG = Xoshiro256PlusPlus>
+    class WeightedReservoir{
+    private:
+        using uint = unsigned int;
+        using Entry = pair<double, E>;
+
+        URBG _rng;
+        size_t _capacity;
+        // A min-heap on the log-key, so the threshold is at the front.
+        vector<Entry> _heap;
+        // The weight left to skip before the next element enters.
+        double _skip = 0;
+
+        static bool greaterKey(const Entry &a, const Entry &b){
+            return a.first > b.first;
+        }
+
+        void drawSkip(){
+            _skip = log(detail::uniform01(_rng)) / _heap.front().first;
+        }
+
+        void add(double key, const E &element){
+            _heap.emplace_back(key, element);
+            push_heap(_heap.begin(), _heap.end(), greaterKey);
+        }
+
+        void replaceFront(double key, const E &element){
+            pop_heap(_heap.begin(), _heap.end(), greaterKey);
+            _heap.back() = Entry(key, element);
+            push_heap(_heap.begin(), _heap.end(), greaterKey);
+        }
+
+    public:
+        WeightedReservoir(size_t capacity, uint64_t seed) : _capacity(capacity) {
+            _rng.seed(seed);
+            _heap.reserve(capacity);
+        }
 
         /**
-         * @brief Returns a random element or `nullopt` if it is empty.
-         * Make sure you have called `update()` after modification of the elements before using this operator.
+         * @brief The seed for the randomizer.
          */
-        optional<E> operator()(){
-            uint random = _dis(_rng);
-            cout << random << endl;
-            for(const Data &data : _data_set){
-                if(random >= data.lower_boundary && random <= data.upper_boundary)
-                    return data.element;
-                else
-                    cout << "not " << data.element << endl;
+        void seed(uint64_t seed){
+            _rng.seed(seed);
+        }
+
+        /**
+         * @brief Returns the maximum number of elements kept.
+         */
+        size_t capacity() const {
+            return _capacity;
+        }
+
+        /**
+         * @brief Returns the number of elements kept.
+         */
+        size_t size() const {
+            return _heap.size();
+        }
+
+        /**
+         * @brief Forgets the stream seen so far.
+         */
+        void clear(){
+            _heap.clear();
+            _skip = 0;
+        }
+
+        /**
+         * @brief Offers an element of the stream with its weight.
+         */
+        void push(const E &element, uint weight){
+            if(weight == 0 || _capacity == 0)
+                return;
+            if(_heap.size() < _capacity){
+                add(log(detail::uniform01(_rng)) / weight, element);
+                if(_heap.size() == _capacity)
+                    drawSkip();
+                return;
             }
-            return nullopt;
+
+            _skip -= weight;
+            if(_skip > 0)
+                return;
+            // The element beats the threshold; draw its key conditioned on that, from `(threshold^weight, 1)`.
+            double low = exp(_heap.front().first * weight);
+            double key = log(low + detail::uniform01(_rng) * (1 - low)) / weight;
+            replaceFront(key, element);
+            drawSkip();
+        }
+
+        /**
+         * @brief Offers every (element, weight) pair of the range.
+         */
+        template<typename InputIt, typename = typename iterator_traits<InputIt>::iterator_category>
+        void push(InputIt first, InputIt last){
+            for(; first != last; ++first)
+                push(first->first, first->second);
+        }
+
+        /**
+         * @brief Combines the sample of another reservoir into this one, as if this one had seen both streams. The
+         * other reservoir must have been filled with a different seed.
+         */
+        void merge(const WeightedReservoir &other){
+            for(const Entry &entry : other._heap){
+                if(_heap.size() < _capacity)
+                    add(entry.first, entry.second);
+                else if(_capacity != 0 && entry.first > _heap.front().first)
+                    replaceFront(entry.first, entry.second);
+            }
+            // The skip is memoryless, so drawing it again against the new threshold is exact.
+            if(_heap.size() == _capacity && _capacity != 0)
+                drawSkip();
+        }
+
+        /**
+         * @brief Returns the elements kept, in no particular order.
+         */
+        vector<E> sample() const {
+            vector<E> ret;
+            ret.reserve(_heap.size());
+            for(const Entry &entry : _heap)
+                ret.push_back(entry.second);
+            return ret;
         }
     };
 
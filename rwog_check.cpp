@@ -0,0 +1,203 @@
+/**
+ * Checks for the claims of rwog.hpp that are easy to break and hard to see. Build and run it with e.g.
+ *
+ *     g++ -std=c++17 -O2 -pthread rwog_check.cpp -o rwog_check && ./rwog_check
+ *
+ * and once more with `-fsanitize=thread` for the concurrent parts. It prints every failed check and exits with 1.
+ */
+#include "rwog.hpp"
+#include <cstdio>
+
+using namespace dzunni;
+
+static int failures = 0;
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+static void check(bool ok, const char *what, int line){
+    if(!ok){
+        fprintf(stderr, "rwog_check.cpp:%d: failed: %s\n", line, what);
+        ++failures;
+    }
+}
+
+// Counts its live copies, so that a check can see when a snapshot is freed.
+struct Tracked {
+    static inline atomic<long> live{0};
+    int value;
+
+    Tracked(int value = 0) : value(value) {
+        ++live;
+    }
+
+    Tracked(const Tracked &other) : value(other.value) {
+        ++live;
+    }
+
+    Tracked& operator=(const Tracked&) = default;
+
+    ~Tracked(){
+        --live;
+    }
+
+    bool operator<(const Tracked &other) const {
+        return value < other.value;
+    }
+};
+
+// A snapshot stays alive while a registered reader may still see it, and is freed by the first `publish()` after
+// every reader has finished a draw with a newer one.
+static void checkSnapshotReclamation(){
+    ConcurrentRandomWeightedObjectGenerator<Tracked> generator;
+    generator.insert(Tracked(1), 1);
+    // The writer's copy of the element.
+    long base = Tracked::live;
+    {
+        auto reader = generator.reader(1);
+        generator.publish();
+        generator.publish();
+        // The reader has not drawn since version 0, so versions 1 and 2 are both alive.
+        CHECK(Tracked::live == base + 2);
+
+        optional<Tracked> drawn = reader();
+        CHECK(drawn && drawn->value == 1);
+        drawn.reset();
+        generator.publish();
+        // The reader finished with version 2, so version 1 is freed; 2 may still be in use, 3 is published.
+        CHECK(Tracked::live == base + 2);
+    }
+    // Without readers, everything but the published version goes.
+    generator.publish();
+    CHECK(Tracked::live == base + 1);
+    CHECK(generator.version() == 4);
+}
+
+// Readers drawing while the writer replaces every element must always see one whole snapshot.
+static void checkConcurrentReaders(){
+    ConcurrentRandomWeightedObjectGenerator<int, AliasSampler> generator;
+    atomic<bool> stop{false};
+    atomic<long> torn{0};
+    vector<thread> readers;
+    for(int t = 0; t < 4; t++){
+        readers.emplace_back([&generator, &stop, &torn, t](){
+            auto reader = generator.reader(t);
+            while(!stop.load(memory_order_relaxed)){
+                // Version v holds exactly the elements [10 v, 10 v + 10).
+                vector<int> sample = reader.sample(8);
+                if(!sample.empty() && any_of(sample.begin(), sample.end(), [&sample](int e){
+                    return e / 10 != sample[0] / 10;
+                }))
+                    ++torn;
+            }
+        });
+    }
+    for(int version = 1; version <= 500; version++){
+        generator.clear();
+        for(int i = 0; i < 10; i++)
+            generator.insert(version * 10 + i, i + 1);
+        generator.publish();
+    }
+    stop = true;
+    for(thread &reader : readers)
+        reader.join();
+    CHECK(torn == 0);
+}
+
+// A batch that inserts the same new element twice is rejected as a whole and leaves the generator as it was, down to
+// the order in which it hands out its free slots.
+template<typename Index>
+static void checkApplyRollback(){
+    using Generator = RandomWeightedObjectGenerator<int, CdfSampler, Xoshiro256PlusPlus, Index>;
+    Generator generator(3);
+    for(int i = 0; i < 100; i++)
+        generator.insert(i, i % 5 + 1);
+    // One free slot, so that one new element reuses it and the other is appended.
+    generator.erase(3);
+    Generator untouched(generator);
+
+    vector<typename Generator::Delta> deltas = {{1, 7}, {1000, 2}, {1001, 4}, {4, 0, true}, {1000, 9}};
+    CHECK(!generator.apply(deltas));
+    CHECK(generator.size() == untouched.size());
+    CHECK(generator.totalWeight() == untouched.totalWeight());
+    CHECK(generator.weight(1) == untouched.weight(1));
+    CHECK(generator.contains(4) && !generator.contains(3));
+    CHECK(!generator.contains(1000) && !generator.contains(1001));
+
+    deltas.pop_back();
+    CHECK(generator.apply(deltas));
+    CHECK(untouched.apply(deltas));
+    generator.seed(5);
+    untouched.seed(5);
+    CHECK(generator.sample(1000) == untouched.sample(1000));
+}
+
+// Known-answer vectors of Philox4x32-10 from the Random123 distribution.
+static void checkPhilox(){
+    struct Vector {
+        uint64_t key;
+        uint64_t stream;
+        uint64_t block;
+        uint32_t expected[4];
+    };
+    const Vector vectors[] = {
+        { 0, 0, 0, { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 } },
+        { UINT64_MAX, UINT64_MAX, UINT64_MAX, { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd } },
+        { 0x299f31d0a4093822, 0x0370734413198a2e, 0x85a308d3243f6a88,
+            { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 } },
+    };
+    for(const Vector &v : vectors){
+        Philox4x32 rng(v.key, v.stream);
+        rng.seek(v.block);
+        for(uint32_t expected : v.expected)
+            CHECK(rng() == expected);
+    }
+
+    // `sampleAt()` depends on the seed, the stream and the index only.
+    RandomWeightedObjectGenerator<int, AliasSampler> generator(7);
+    for(int i = 0; i < 100; i++)
+        generator.insert(i, i % 9 + 1);
+    vector<int> slice;
+    generator.sampleAt(1000, 5000, back_inserter(slice), 3);
+    generator.sample(123);
+    CHECK(generator.sampleAt(1000 + 4321, 3) == slice[4321]);
+}
+
+// The static engines, and `freeze()`, build the same tables on any number of threads, so a seed draws the same
+// elements. The size spans several blocks of `parallel_grain`, and the few distinct weights make the alias
+// construction hit its ties.
+template<typename Sampler>
+static void checkIdenticalTables(){
+    vector<int> reference, frozen_reference;
+    for(unsigned threads : {1u, 2u, 3u, 0u}){
+        RandomWeightedObjectGenerator<int, Sampler> generator(11);
+        generator.buildThreads(threads);
+        for(int i = 0; i < 300000; i++)
+            generator.insert(i, i % 4);
+        vector<int> sample = generator.sample(100000);
+        generator.freeze();
+        vector<int> frozen_sample = generator.sample(100000);
+        if(threads == 1){
+            reference = sample;
+            frozen_reference = frozen_sample;
+        }
+        CHECK(sample == reference);
+        CHECK(frozen_sample == frozen_reference);
+    }
+}
+
+int main(){
+    checkSnapshotReclamation();
+    checkConcurrentReaders();
+    checkApplyRollback<OrderedIndex>();
+    checkApplyRollback<HashIndex>();
+    checkPhilox();
+    checkIdenticalTables<CdfSampler>();
+    checkIdenticalTables<AliasSampler>();
+    checkIdenticalTables<GuideTableSampler>();
+    if(failures != 0){
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    puts("All checks passed.");
+    return 0;
+}